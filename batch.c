@@ -0,0 +1,435 @@
+/*
+ * batch.c - Source for running many commands in one response.
+ *
+ * A batch is a list of commands run one after another in a single
+ * request, either given inline split by ';' or loaded from a script
+ * file. Scripts are resolved once when they are loaded, so running one
+ * skips tokenizing and the command lookup; they are only resolved again
+ * after the plugins changed, which is checked before every step since a
+ * step may reload them. The output of each command is collected
+ * and sent behind a header line with its status, so the whole batch is
+ * one response with one prompt.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <dirent.h>
+
+#include "batch.h"
+#include "parse.h"
+#include "plugin.h"
+#include "output.h"
+#include "log.h"
+#include "mem.h"
+
+/* Longest line of a script. */
+#define BATCH_LINE 256
+
+/* Step of a batch definition and typedef. */
+struct BatchStep {
+	const Command *cmd;
+	Argument *args;
+	char *text;
+	char *buf;
+	int error;
+};
+typedef struct BatchStep BatchStep;
+
+/* Script definition and typedef. */
+struct BatchScript {
+	char name[BATCH_NAME];
+	BatchStep *steps;
+	unsigned int count;
+	unsigned int gen;
+	unsigned long runs;
+	unsigned long failed;
+};
+typedef struct BatchScript BatchScript;
+
+extern volatile sig_atomic_t global_done;
+
+static BatchScript scripts[BATCH_SCRIPTS];
+static int script_count;
+static const char *script_dir;
+static int running;
+
+/* Resolve a step from its text, returns a parse_prepare() result.
+ */
+static int batch_resolve(BatchStep *st)
+{
+	pm_free(st->args);
+	st->args = NULL;
+	strcpy(st->buf, st->text);
+	return parse_prepare(st->buf, &st->cmd, &st->args);
+}
+
+/* Make a step of a command, returns 1 if made, 0 if it was empty and
+ * -1 if out of memory.
+ */
+static int batch_step(BatchStep *st, const char *owner, const char *text,
+	unsigned int len)
+{
+	while(len > 0 && (*text == ' ' || *text == '\t')) {
+		text++;
+		len--;
+	}
+	while(len > 0 && strchr(" \t\r\n", text[len - 1]) != NULL) {
+		len--;
+	}
+	if(len == 0) {
+		return 0;
+	}
+
+	memset(st, 0, sizeof(BatchStep));
+	st->text = (char *)mem_alloc(owner, len + 1);
+	st->buf = (char *)mem_alloc(owner, len + 1);
+	if(st->text == NULL || st->buf == NULL) {
+		mem_free(st->text);
+		mem_free(st->buf);
+		return -1;
+	}
+	memcpy(st->text, text, len);
+	st->text[len] = '\0';
+	st->error = batch_resolve(st);
+	return 1;
+}
+
+/* Free steps of a batch.
+ */
+static void batch_free(BatchStep *steps, unsigned int count)
+{
+	unsigned int i;
+
+	for(i = 0; i < count; i++) {
+		pm_free(steps[i].args);
+		mem_free(steps[i].text);
+		mem_free(steps[i].buf);
+	}
+}
+
+/* Resolve steps again if the commands of plugins moved since gen,
+ * shared steps are charged to nobody.
+ */
+static void batch_refresh(BatchStep *steps, unsigned int count,
+	unsigned int *gen, int shared)
+{
+	Session *charged = NULL;
+	unsigned int i;
+
+	if(*gen == pm_generation()) {
+		return;
+	}
+	if(shared) {
+		charged = mem_charge(NULL);
+	}
+	for(i = 0; i < count; i++) {
+		steps[i].error = batch_resolve(&steps[i]);
+	}
+	*gen = pm_generation();
+	if(shared) {
+		mem_charge(charged);
+	}
+}
+
+/* Run steps, sending each output behind its header line.
+ */
+static int batch_run(const SOCKET fd, BatchStep *steps, unsigned int count,
+	unsigned int *gen, int shared, int mode)
+{
+	unsigned int run = 0, failed = 0;
+	char head[BATCH_LINE+64];
+	unsigned int i;
+	int len;
+
+	running = 1;
+	for(i = 0; i < count && !global_done; i++) {
+		Session *s = session_get(fd);
+		const unsigned char *out = NULL;
+		int rc;
+
+		if(s == NULL || s->quit || out_divert(fd) < 0) {
+			break;
+		}
+
+		/* A step before may have reloaded the plugins. */
+		batch_refresh(steps, count, gen, shared);
+		if(steps[i].error != PARSE_OK) {
+			const char *msg = parse_message(steps[i].error);
+			out_send(fd, msg, strlen(msg));
+			rc = 1;
+		}
+		else {
+			rc = parse_exec(fd, steps[i].cmd, steps[i].args);
+		}
+		len = out_collect(fd, &out);
+
+		run++;
+		failed += rc != 0;
+		len = len < 0 ? 0 : len;
+		snprintf(head, sizeof(head), "#%u %d %d %s\r\n", i + 1, rc, len,
+			steps[i].text);
+		out_send(fd, head, strlen(head));
+		out_send(fd, out, len);
+		if(rc != 0 && mode == BATCH_STOP) {
+			break;
+		}
+	}
+	running = 0;
+
+	snprintf(head, sizeof(head), "#end %u %u %u\r\n", run, failed,
+		count - run);
+	out_send(fd, head, strlen(head));
+	return run < count || failed > 0;
+}
+
+/* Read a script file, returns -1 if it cannot be used.
+ */
+static int batch_read(BatchScript *sc, const char *path)
+{
+	BatchStep steps[BATCH_STEPS];
+	char line[BATCH_LINE];
+	unsigned int count = 0;
+	unsigned int no = 0;
+	int rc = 0;
+	FILE *fp;
+
+	if((fp = fopen(path, "r")) == NULL) {
+		return -1;
+	}
+	while(rc == 0 && fgets(line, sizeof(line), fp) != NULL) {
+		const char *p = line;
+
+		no++;
+		if(strchr(line, '\n') == NULL && !feof(fp)) {
+			log_write(PMLOG_WARN, "Script %s, line %u is too long.",
+				sc->name, no);
+			rc = -1;
+			break;
+		}
+		while(*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if(*p == '#') {
+			continue;
+		}
+		if(count == BATCH_STEPS) {
+			log_write(PMLOG_WARN, "Script %s has more than %d commands.",
+				sc->name, BATCH_STEPS);
+			rc = -1;
+			break;
+		}
+		switch(batch_step(&steps[count], MEM_SCRIPTS, p, strlen(p))) {
+			case 0:
+			break;
+			case 1:
+				if(steps[count++].error != PARSE_OK) {
+					log_write(PMLOG_WARN, "Script %s, line %u: cannot "
+						"parse '%s'.", sc->name, no, steps[count - 1].text);
+					rc = -1;
+				}
+			break;
+			default:
+				rc = -1;
+			break;
+		}
+	}
+	fclose(fp);
+
+	if(rc == 0 && count > 0) {
+		sc->steps = (BatchStep *)mem_calloc(MEM_SCRIPTS, count,
+			sizeof(BatchStep));
+		if(sc->steps != NULL) {
+			memcpy(sc->steps, steps, count * sizeof(BatchStep));
+			sc->count = count;
+			sc->gen = pm_generation();
+			return 0;
+		}
+	}
+	batch_free(steps, count);
+	return -1;
+}
+
+/* Load every script of a directory.
+ */
+static int batch_load(const char *dirname)
+{
+	const unsigned int ext = strlen(BATCH_EXT);
+	Session *charged = mem_charge(NULL);
+	struct dirent *p;
+	DIR *dir;
+
+	if((dir = opendir(dirname)) == NULL) {
+		mem_charge(charged);
+		return -1;
+	}
+	while((p = readdir(dir)) != NULL && script_count < BATCH_SCRIPTS) {
+		BatchScript *sc = &scripts[script_count];
+		unsigned int len = strlen(p->d_name);
+		char path[2048];
+
+		if(len <= ext || len - ext >= BATCH_NAME
+				|| strcmp(p->d_name + len - ext, BATCH_EXT)) {
+			continue;
+		}
+
+		memset(sc, 0, sizeof(BatchScript));
+		memcpy(sc->name, p->d_name, len - ext);
+		snprintf(path, sizeof(path)-1, "%s/%s", dirname, p->d_name);
+		if(batch_read(sc, path) == 0) {
+			script_count++;
+		}
+	}
+	closedir(dir);
+	mem_charge(charged);
+	return script_count;
+}
+
+/* Find a script by name.
+ */
+static BatchScript *batch_find(const char *name)
+{
+	int i;
+
+	for(i = 0; i < script_count; i++) {
+		if(!strncmp(scripts[i].name, name, BATCH_NAME)) {
+			return &scripts[i];
+		}
+	}
+	return NULL;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Load scripts of a directory, pre-parsing every command.
+ */
+int batch_init(const char *dirname)
+{
+	script_dir = dirname;
+	if(batch_load(dirname) > 0) {
+		log_write(PMLOG_INFO, "Loaded %d scripts from %s.", script_count,
+			dirname);
+	}
+	return 0;
+}
+
+/* Load scripts again from the same directory.
+ */
+int batch_reload(void)
+{
+	DIR *dir;
+
+	if(running || script_dir == NULL) {
+		return -1;
+	}
+
+	/* Keep the scripts there are if the directory is gone. */
+	if((dir = opendir(script_dir)) == NULL) {
+		return -1;
+	}
+	closedir(dir);
+	batch_deinit();
+	return batch_load(script_dir);
+}
+
+/* Run commands separated by ';'.
+ */
+int batch_inline(const SOCKET fd, const char *text, int mode)
+{
+	BatchStep steps[BATCH_STEPS];
+	unsigned int gen = pm_generation();
+	unsigned int count = 0;
+	int rc = 0;
+
+	if(running) {
+		out_send(fd, "Batches cannot be nested.\r\n", 27);
+		return 1;
+	}
+	while(*text != '\0') {
+		const char *end = strchr(text, ';');
+		unsigned int len = end != NULL ? (unsigned int)(end - text)
+			: strlen(text);
+
+		if(count == BATCH_STEPS) {
+			out_send(fd, "Too many commands.\r\n", 20);
+			rc = -1;
+			break;
+		}
+		if((rc = batch_step(&steps[count], MEM_BATCH, text, len)) < 0) {
+			out_send(fd, "Out of memory.\r\n", 16);
+			break;
+		}
+		count += rc;
+		text += len + (end != NULL);
+	}
+
+	if(rc >= 0 && count == 0) {
+		out_send(fd, "No commands.\r\n", 14);
+		rc = -1;
+	}
+	rc = rc < 0 ? 1 : batch_run(fd, steps, count, &gen, 0, mode);
+	batch_free(steps, count);
+	return rc;
+}
+
+/* Run a script by name.
+ */
+int batch_script(const SOCKET fd, const char *name, int mode)
+{
+	BatchScript *sc = batch_find(name);
+	int rc;
+
+	if(running) {
+		out_send(fd, "Batches cannot be nested.\r\n", 27);
+		return 1;
+	}
+	if(sc == NULL) {
+		out_send(fd, "No such script.\r\n", 17);
+		return 1;
+	}
+
+	sc->runs++;
+	if((rc = batch_run(fd, sc->steps, sc->count, &sc->gen, 1,
+			mode)) != 0) {
+		sc->failed++;
+	}
+	return rc;
+}
+
+/* Show loaded scripts.
+ */
+void batch_show(const SOCKET fd)
+{
+	char buf[256];
+	int i;
+
+	snprintf(buf, sizeof(buf)-1, "%-32s %-8s %-10s %s\r\n", "Script",
+		"Steps", "Runs", "Failed");
+	out_send(fd, buf, strlen(buf));
+	for(i = 0; i < script_count; i++) {
+		snprintf(buf, sizeof(buf)-1, "%-32s %-8u %-10lu %lu\r\n",
+			scripts[i].name, scripts[i].count, scripts[i].runs,
+			scripts[i].failed);
+		out_send(fd, buf, strlen(buf));
+	}
+}
+
+/* Free all scripts.
+ */
+void batch_deinit(void)
+{
+	int i;
+
+	for(i = 0; i < script_count; i++) {
+		batch_free(scripts[i].steps, scripts[i].count);
+		mem_free(scripts[i].steps);
+	}
+	memset(scripts, 0, sizeof(scripts));
+	script_count = 0;
+}
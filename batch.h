@@ -0,0 +1,46 @@
+/*
+ * batch.h - Header for running many commands in one response.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "prs/network.h"
+
+/* Most commands in a batch. */
+#define BATCH_STEPS 64
+/* Most scripts loaded. */
+#define BATCH_SCRIPTS 64
+/* Longest script name. */
+#define BATCH_NAME 32
+/* File name extension of scripts. */
+#define BATCH_EXT ".batch"
+
+/* What a batch does when a command fails. */
+enum { BATCH_STOP, BATCH_CONTINUE };
+
+/* Load scripts of a directory, pre-parsing every command. */
+extern int batch_init(const char *dirname);
+
+/* Load scripts again from the same directory, returns how many or -1
+ * if it cannot be read. */
+extern int batch_reload(void);
+
+/* Run commands separated by ';', returns non zero if one failed. */
+extern int batch_inline(const SOCKET fd, const char *text, int mode);
+
+/* Run a script by name, returns non zero if a command failed. */
+extern int batch_script(const SOCKET fd, const char *name, int mode);
+
+/* Show loaded scripts. */
+extern void batch_show(const SOCKET fd);
+
+/* Free all scripts. */
+extern void batch_deinit(void);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * microbench.c - Source for microbenchmarks of the parser and plugins.
+ *
+ * Benchmarks run against a null sink instead of a client and copy the
+ * example plugins into a scratch directory to get many of them. Results
+ * are written one JSON object per line.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "parse.h"
+#include "plugin.h"
+
+/* Each benchmark runs for about this long (ns). */
+#define BENCH_TIME 200000000ULL
+#define BENCH_LINE 1024
+
+/* Allocation counters, filled in by the malloc wrappers and the
+ * allocator handed to plugins. */
+static unsigned long allocs;
+static unsigned long sink_bytes;
+static const char *commit = "unknown";
+static FILE *out;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+/* Count allocations made by the code under test.
+ */
+void *__wrap_malloc(size_t size)
+{
+	++allocs;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	++allocs;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	++allocs;
+	return __real_realloc(p, size);
+}
+
+/* Count allocations of the plugins, --wrap does not reach into their
+ * shared objects but their pm_malloc() calls come through here.
+ */
+static void *bench_realloc(const char *owner, void *ptr, size_t size)
+{
+	++allocs;
+	return __real_realloc(ptr, size);
+}
+
+/* Free memory from bench_realloc().
+ */
+static void bench_free(void *ptr)
+{
+	free(ptr);
+}
+
+/* Null sink standing in for a client.
+ */
+static int sink_send(const SOCKET fd, const void *buf, int len)
+{
+	sink_bytes += len;
+	return len;
+}
+
+/* Logging is dropped, the example plugin logs on every call.
+ */
+static void sink_log(int level, const char *fmt, va_list ap)
+{
+}
+
+static const PluginAPI bench_api = {
+	sink_send,
+	NULL,
+	NULL,
+	sink_log,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	bench_realloc,
+	bench_free
+};
+
+/* Builtin commands that do nothing, sized like the real table. */
+static int cmd_nop(const SOCKET fd, const Argument *args)
+{
+	return 0;
+}
+
+static Command cmds[] = {
+	{ "help", "", "", cmd_nop, 0, 0 },
+	{ "when", "s", "", cmd_nop, 0, 0 },
+	{ "list", "", "", cmd_nop, 0, 0 },
+	{ "sdir", "s", "", cmd_nop, 0, 0 },
+	{ "pdir", "", "", cmd_nop, 0, 0 },
+	{ "cdir", "", "", cmd_nop, 0, 0 },
+	{ "run", "s", "", cmd_nop, 0, 0 },
+	{ "mods", "s", "", cmd_nop, 0, 0 },
+	{ "exit", "", "", cmd_nop, 0, 0 }
+};
+
+/* Get nanoseconds from a monotonic clock.
+ */
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Run a benchmark until BENCH_TIME has passed and print the result.
+ */
+static void bench(const char *name, void (*func)(void *arg), void *arg)
+{
+	unsigned long long start, elapsed, iters = 0, batch = 1;
+	unsigned long count;
+	unsigned long long i;
+
+	func(arg);
+	count = allocs;
+	start = now_ns();
+	do {
+		for(i = 0; i < batch; i++) {
+			func(arg);
+		}
+		iters += batch;
+		batch *= 2;
+		elapsed = now_ns() - start;
+	} while(elapsed < BENCH_TIME);
+	count = allocs - count;
+
+	fprintf(out, "{\"commit\":\"%s\",\"bench\":\"%s\",\"iters\":%llu,"
+		"\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n",
+		commit, name, iters, (double)elapsed / iters,
+		(double)count / iters);
+	fflush(out);
+}
+
+/* Parse a line through parse_input().
+ */
+static void bench_parse(void *arg)
+{
+	char line[BENCH_LINE];
+
+	snprintf(line, sizeof(line), "%s", (const char *)arg);
+	parse_input(0, line);
+}
+
+/* Parse arguments through arg_parser().
+ */
+static void bench_args(void *arg)
+{
+	char line[BENCH_LINE];
+	Argument *args;
+
+	snprintf(line, sizeof(line), "%s", (const char *)arg);
+	strtok(line, DELIM);
+	args = arg_parser("sdf");
+	pm_free(args);
+}
+
+/* Look up a module through pm_find().
+ */
+static void bench_find(void *arg)
+{
+	(void)pm_find((const char *)arg);
+}
+
+/* Load and unload all plugins of a directory.
+ */
+static void bench_cycle(void *arg)
+{
+	pm_init((const char *)arg);
+	pm_register(INVALID_SOCKET);
+	pm_deinit();
+}
+
+/* Copy a file.
+ */
+static int copy_file(const char *from, const char *to)
+{
+	char buf[8192];
+	FILE *in, *fp;
+	size_t n;
+
+	if((in = fopen(from, "rb")) == NULL) {
+		return -1;
+	}
+	if((fp = fopen(to, "wb")) == NULL) {
+		fclose(in);
+		return -1;
+	}
+	while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fwrite(buf, 1, n, fp);
+	}
+	fclose(in);
+	fclose(fp);
+	return 0;
+}
+
+/* Fill a scratch directory with copies of a plugin.
+ */
+static int make_plugins(const char *dir, const char *sdk,
+	const char *plugin, const char *prefix, int count)
+{
+	char from[1024], to[1024];
+	int i;
+
+	snprintf(from, sizeof(from), "%s/%s", sdk, plugin);
+	for(i = 0; i < count; i++) {
+		snprintf(to, sizeof(to), "%s/%s%03d.so", dir, prefix, i);
+		if(copy_file(from, to) < 0) {
+			fprintf(stderr, "Error: Cannot copy %s.\n", from);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Remove a scratch directory and its plugins.
+ */
+static void remove_plugins(const char *dir)
+{
+	char cmd[1100];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+	if(system(cmd) != 0) {
+		fprintf(stderr, "Warning: Cannot remove %s.\n", dir);
+	}
+}
+
+/* Show how to use this program.
+ */
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c commit] [-o file] plugin-sdk-dir\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int counts[] = { 1, 10, 100 };
+	char dir[] = "/tmp/netcom-bench-XXXXXX";
+	char name[128];
+	unsigned int i;
+	int opt;
+
+	out = stdout;
+	while((opt = getopt(argc, argv, "c:o:")) != -1) {
+		switch(opt) {
+			case 'c':
+				commit = optarg;
+			break;
+			case 'o':
+				if((out = fopen(optarg, "a")) == NULL) {
+					fprintf(stderr, "Error: Cannot open %s.\n",
+						optarg);
+					return 1;
+				}
+			break;
+			default:
+				usage(argv[0]);
+				return 1;
+			break;
+		}
+	}
+	if(optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	pm_setapi(&bench_api);
+	parse_init(cmds, sizeof(cmds) / sizeof(cmds[0]));
+
+	bench("parse_input/short", bench_parse, "help\n");
+	bench("parse_input/args", bench_parse, "when time\n");
+	bench("parse_input/long", bench_parse,
+		"sdir /a/very/long/directory/name/that/keeps/going/and/going/"
+		"until/it/is/well/past/the/usual/length/of/a/path\r\n");
+	bench("parse_input/empty", bench_parse, "   \r\n");
+	bench("parse_input/extra_args", bench_parse, "help me please\n");
+	bench("parse_input/missing_args", bench_parse, "when\n");
+	bench("arg_parser/sdf", bench_args, "cmd word 42 3.5");
+	bench("arg_parser/short", bench_args, "cmd word");
+
+	if(mkdtemp(dir) == NULL) {
+		fprintf(stderr, "Error: Cannot create scratch directory.\n");
+		return 1;
+	}
+
+	for(i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		remove_plugins(dir);
+		if(mkdir(dir, 0700) != 0 || make_plugins(dir, argv[optind],
+				"plugin1.so", "c", counts[i]) < 0
+				|| make_plugins(dir, argv[optind],
+				"plugin2.so", "m", counts[i]) < 0) {
+			remove_plugins(dir);
+			return 1;
+		}
+
+		pm_init(dir);
+		pm_register(INVALID_SOCKET);
+
+		snprintf(name, sizeof(name), "dispatch/builtin/%d", counts[i]);
+		bench(name, bench_parse, "help\n");
+		snprintf(name, sizeof(name), "dispatch/plugin_hit/%d",
+			counts[i]);
+		bench(name, bench_parse, "dummy\n");
+		snprintf(name, sizeof(name), "dispatch/plugin_miss/%d",
+			counts[i]);
+		bench(name, bench_parse, "missing\n");
+		snprintf(name, sizeof(name), "pm_find/%d", counts[i]);
+		bench(name, bench_find, "nothere");
+
+		pm_deinit();
+
+		snprintf(name, sizeof(name), "pm_cycle/%d", counts[i] * 2);
+		bench(name, bench_cycle, dir);
+	}
+	remove_plugins(dir);
+
+	if(out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * capture.c - Source for session capture to a binary file.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "timer.h"
+
+static FILE *fp;
+static int capture_flags;
+static unsigned long long last;
+static long records;
+
+/* Write an unsigned LEB128 integer.
+ */
+static void capture_varint(unsigned long long v)
+{
+	unsigned char buf[10];
+	int len = 0;
+
+	do {
+		buf[len] = v & 0x7f;
+		v >>= 7;
+		if(v) {
+			buf[len] |= 0x80;
+		}
+		++len;
+	} while(v);
+	fwrite(buf, 1, len, fp);
+}
+
+/* Write type, time and session of a record.
+ */
+static void capture_record(int type, const Session *s)
+{
+	unsigned long long now = timer_clock();
+
+	fputc(type, fp);
+	capture_varint(now - last);
+	capture_varint(s->id);
+	last = now;
+	++records;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Start capturing all sessions to a file.
+ */
+int capture_start(const char *path, int flags)
+{
+	unsigned long long start = (unsigned long long)time(NULL) * 1000ULL;
+	unsigned char hdr[14];
+	int i;
+
+	if(fp != NULL || (fp = fopen(path, "wb")) == NULL) {
+		return -1;
+	}
+	setvbuf(fp, NULL, _IOFBF, 65536);
+
+	memcpy(hdr, CAPTURE_MAGIC, 4);
+	hdr[4] = CAPTURE_VERSION;
+	hdr[5] = flags;
+	for(i = 0; i < 8; i++) {
+		hdr[6+i] = (start >> (8 * i)) & 0xff;
+	}
+	fwrite(hdr, 1, sizeof(hdr), fp);
+
+	capture_flags = flags;
+	last = timer_clock();
+	records = 0;
+	return 0;
+}
+
+/* Stop capturing.
+ */
+long capture_stop(void)
+{
+	if(fp == NULL) {
+		return -1;
+	}
+	fclose(fp);
+	fp = NULL;
+	return records;
+}
+
+/* Check if capture is running.
+ */
+int capture_active(void)
+{
+	return fp != NULL;
+}
+
+/* Record a new session.
+ */
+void capture_open(const Session *s)
+{
+	if(fp != NULL && s != NULL) {
+		capture_record(CAPTURE_OPEN, s);
+	}
+}
+
+/* Record a command line received from a session.
+ */
+void capture_command(const Session *s, const char *line, unsigned int len)
+{
+	if(fp != NULL) {
+		capture_record(CAPTURE_COMMAND, s);
+		capture_varint(len);
+		fwrite(line, 1, len, fp);
+	}
+}
+
+/* Record size and latency of a response.
+ */
+void capture_response(const Session *s, unsigned long size,
+	unsigned long latency)
+{
+	if(fp != NULL && (capture_flags & CAPTURE_RESPONSES)) {
+		capture_record(CAPTURE_RESPONSE, s);
+		capture_varint(size);
+		capture_varint(latency);
+	}
+}
+
+/* Record a closed session.
+ */
+void capture_close(const Session *s)
+{
+	if(fp != NULL) {
+		capture_record(CAPTURE_CLOSE, s);
+	}
+}
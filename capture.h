@@ -0,0 +1,61 @@
+/*
+ * capture.h - Header for session capture to a binary file.
+ *
+ * Capture file layout, integers marked (v) are unsigned LEB128:
+ *
+ *   header : "NCAP" version(1) flags(1) start(8, ms since epoch, LE)
+ *   record : type(1) time(v, ms since last record) session(v) ...
+ *     'O'  : open, nothing else
+ *     'C'  : command, length(v) bytes
+ *     'R'  : response, size(v) latency(v, us)
+ *     'X'  : close, nothing else
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "session.h"
+
+#define CAPTURE_MAGIC "NCAP"
+#define CAPTURE_VERSION 1
+/* File written by capture_start(). */
+#define CAPTURE_FILE "netcom-capture.bin"
+
+/* Capture flags and record types. */
+enum { CAPTURE_RESPONSES = 1 };
+enum {
+	CAPTURE_OPEN = 'O',
+	CAPTURE_COMMAND = 'C',
+	CAPTURE_RESPONSE = 'R',
+	CAPTURE_CLOSE = 'X'
+};
+
+/* Start capturing all sessions to a file. */
+extern int capture_start(const char *path, int flags);
+
+/* Stop capturing, returns number of records written. */
+extern long capture_stop(void);
+
+/* Check if capture is running. */
+extern int capture_active(void);
+
+/* Record a new session. */
+extern void capture_open(const Session *s);
+
+/* Record a command line received from a session. */
+extern void capture_command(const Session *s, const char *line,
+	unsigned int len);
+
+/* Record size and latency of a response. */
+extern void capture_response(const Session *s, unsigned long size,
+	unsigned long latency);
+
+/* Record a closed session. */
+extern void capture_close(const Session *s);
+
+#endif
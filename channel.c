@@ -0,0 +1,624 @@
+/*
+ * channel.c - Source for logical sessions multiplexed on a connection.
+ *
+ * After 'channel on' a connection carries nothing but frames. Clients
+ * open channels by id, each channel is a session of its own with its
+ * own output mode, tracing and deadlines, and the answers of all of
+ * them come back interleaved in frames tagged with the channel id.
+ * Every channel has a window in each direction: output the client has
+ * not granted credit for is held back and the channel runs no further
+ * commands until it is sent, while the other channels carry on. A
+ * command never waits for credit: one that fills the queue is cancelled
+ * and its channel closed. Frames the socket does not take right away
+ * wait in the output queue of the connection, so a client that stops
+ * reading altogether is closed rather than stalling the server.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "channel.h"
+#include "output.h"
+#include "trace.h"
+#include "log.h"
+#include "limit.h"
+#include "capture.h"
+#include "timer.h"
+#include "mem.h"
+
+/* Largest window a client may grant. */
+#define CHANNEL_CREDIT_MAX 0x40000000L
+
+/* Tell program that it's finished. */
+extern volatile sig_atomic_t global_done;
+
+/* Channel definition and typedef. */
+struct Channel {
+	struct ChannelMux *mux;
+	Session *sess;
+	unsigned int id;
+	int closing;
+	long window;
+	unsigned int credit;
+	unsigned char *in;
+	unsigned int inlen;
+	unsigned int insize;
+	unsigned char *out;
+	unsigned int head;
+	unsigned int queued;
+	unsigned int size;
+	unsigned long sent;
+	unsigned long received;
+	unsigned long dropped;
+	int full;
+};
+typedef struct Channel Channel;
+
+/* Channel connection definition and typedef. */
+struct ChannelMux {
+	Session *conn;
+	int dead;
+	unsigned int used;
+	unsigned char in[CHANNEL_HDRLEN+CHANNEL_CHUNK];
+	unsigned char frame[CHANNEL_HDRLEN+CHANNEL_CHUNK];
+	Channel *chans[CHANNEL_MAX];
+};
+typedef struct ChannelMux ChannelMux;
+
+static ChannelRun channel_serve;
+static unsigned int next_fd;
+static int total;
+
+/* Make room for need bytes in a buffer, charged to session s.
+ */
+static int channel_grow(Session *s, unsigned char **buf, unsigned int *size,
+	unsigned int need)
+{
+	unsigned int len = *size ? *size : 1024;
+	unsigned char *tmp;
+	Session *prev;
+
+	while(len < need) {
+		len *= 2;
+	}
+	if(len != *size) {
+		prev = mem_charge(s);
+		tmp = (unsigned char *)mem_realloc(MEM_IO, *buf, len);
+		mem_charge(prev);
+		if(tmp == NULL) {
+			return -1;
+		}
+		*buf = tmp;
+		*size = len;
+	}
+	return 0;
+}
+
+/* Send a frame on the connection.
+ */
+static int channel_frame(ChannelMux *m, int type, unsigned int id,
+	const void *data, unsigned int len)
+{
+	if(m->dead) {
+		return -1;
+	}
+	m->frame[0] = (unsigned char)type;
+	m->frame[1] = (id >> 8) & 0xff;
+	m->frame[2] = id & 0xff;
+	m->frame[3] = (len >> 24) & 0xff;
+	m->frame[4] = (len >> 16) & 0xff;
+	m->frame[5] = (len >> 8) & 0xff;
+	m->frame[6] = len & 0xff;
+	if(len > 0) {
+		memcpy(m->frame + CHANNEL_HDRLEN, data, len);
+	}
+	if(session_write(m->conn, m->frame, len + CHANNEL_HDRLEN) < 0) {
+		m->dead = 1;
+		return -1;
+	}
+	return 0;
+}
+
+/* Find a channel of a connection by id.
+ */
+static Channel *channel_find(ChannelMux *m, unsigned int id)
+{
+	int i;
+
+	for(i = 0; i < CHANNEL_MAX; i++) {
+		if(m->chans[i] != NULL && m->chans[i]->id == id) {
+			return m->chans[i];
+		}
+	}
+	return NULL;
+}
+
+/* Send as much held output as the window allows.
+ */
+static int channel_flush(Channel *ch)
+{
+	while(ch->queued > 0 && ch->window > 0) {
+		unsigned int n = ch->queued;
+
+		if(n > CHANNEL_CHUNK) {
+			n = CHANNEL_CHUNK;
+		}
+		if((long)n > ch->window) {
+			n = (unsigned int)ch->window;
+		}
+		if(channel_frame(ch->mux, CHANNEL_FRAME_DATA, ch->id,
+				ch->out + ch->head, n) < 0) {
+			return -1;
+		}
+		ch->head += n;
+		ch->queued -= n;
+		ch->window -= n;
+		ch->sent += n;
+	}
+	if(ch->queued == 0) {
+		ch->head = 0;
+	}
+	return 0;
+}
+
+/* Open a channel for a client.
+ */
+static int channel_open(ChannelMux *m, unsigned int id)
+{
+	Channel *ch = NULL;
+	Session *s = NULL;
+	SOCKET fd;
+	int i, slot = -1;
+
+	if(id == 0 || channel_find(m, id) != NULL) {
+		return channel_frame(m, CHANNEL_FRAME_CLOSE, id,
+			"Channel in use.\r\n", 17);
+	}
+	for(i = 0; i < CHANNEL_MAX && slot < 0; i++) {
+		if(m->chans[i] == NULL) {
+			slot = i;
+		}
+	}
+	if(slot >= 0 && (ch = (Channel *)mem_calloc(MEM_SESSIONS, 1,
+			sizeof(Channel))) != NULL) {
+		do {
+			fd = (SOCKET)(CHANNEL_BASE + (next_fd++ % CHANNEL_BASE));
+		} while(session_get(fd) != NULL);
+		s = session_open(fd, m->conn->addr);
+	}
+	if(s == NULL) {
+		mem_free(ch);
+		log_write(PMLOG_WARN, "Server busy, channel of %s rejected.",
+			m->conn->addr);
+		return channel_frame(m, CHANNEL_FRAME_CLOSE, id,
+			"Server busy, try again later.\r\n", 31);
+	}
+
+	ch->mux = m;
+	ch->sess = s;
+	ch->id = id;
+	ch->window = CHANNEL_WINDOW;
+	s->chan = ch;
+	s->limit = limit_attach(s->addr);
+	m->chans[slot] = ch;
+	++total;
+	capture_open(s);
+	log_write(PMLOG_DEBUG, "Client %s opened channel %u.", s->addr, id);
+
+	if(channel_frame(m, CHANNEL_FRAME_OPEN, id, NULL, 0) < 0) {
+		return -1;
+	}
+	out_send(fd, ">> ", 4);
+	out_end(fd);
+	return channel_flush(ch);
+}
+
+/* Free a channel and its session, ack tells the client it is gone.
+ */
+static void channel_free(Channel *ch, int ack)
+{
+	ChannelMux *m = ch->mux;
+	Session *s = ch->sess;
+	int i;
+
+	for(i = 0; i < CHANNEL_MAX; i++) {
+		if(m->chans[i] == ch) {
+			m->chans[i] = NULL;
+		}
+	}
+	if(ack && ch->full) {
+		channel_frame(m, CHANNEL_FRAME_CLOSE, ch->id,
+			"Output queue full.\r\n", 20);
+	}
+	else if(ack) {
+		channel_frame(m, CHANNEL_FRAME_CLOSE, ch->id, NULL, 0);
+	}
+	log_write(PMLOG_DEBUG, "Client %s closed channel %u.", s->addr,
+		ch->id);
+	capture_close(s);
+	limit_disconnect(s->limit);
+	session_close(s->fd);
+	mem_free(ch->in);
+	mem_free(ch->out);
+	mem_free(ch);
+	--total;
+}
+
+/* Handle every complete frame read from a connection.
+ */
+static int channel_parse(ChannelMux *m)
+{
+	unsigned int pos = 0;
+	int rc = 0;
+
+	while(rc == 0 && m->used - pos >= CHANNEL_HDRLEN) {
+		const unsigned char *p = m->in + pos;
+		unsigned int id = (p[1] << 8) | p[2];
+		unsigned int len = ((unsigned int)p[3] << 24) | (p[4] << 16)
+			| (p[5] << 8) | p[6];
+		int type = p[0];
+		unsigned long credit;
+		Channel *ch;
+
+		if(len > CHANNEL_CHUNK) {
+			rc = -1;
+			break;
+		}
+		if(m->used - pos < CHANNEL_HDRLEN + len) {
+			break;
+		}
+		p += CHANNEL_HDRLEN;
+		pos += CHANNEL_HDRLEN + len;
+		ch = channel_find(m, id);
+
+		switch(type) {
+			case CHANNEL_FRAME_OPEN:
+				rc = channel_open(m, id);
+			break;
+			case CHANNEL_FRAME_DATA:
+				/* Data may still be on its way after a close. */
+				if(ch == NULL || ch->closing || len == 0) {
+					break;
+				}
+				if(ch->inlen + len > CHANNEL_WINDOW
+						|| channel_grow(NULL, &ch->in, &ch->insize,
+						ch->inlen + len) < 0) {
+					rc = -1;
+					break;
+				}
+				memcpy(ch->in + ch->inlen, p, len);
+				ch->inlen += len;
+				ch->received += len;
+			break;
+			case CHANNEL_FRAME_CREDIT:
+				if(len != 4) {
+					rc = -1;
+					break;
+				}
+				if(ch == NULL) {
+					break;
+				}
+				credit = ((unsigned long)p[0] << 24) | (p[1] << 16)
+					| (p[2] << 8) | p[3];
+				if(credit > (unsigned long)(CHANNEL_CREDIT_MAX
+						- ch->window)) {
+					ch->window = CHANNEL_CREDIT_MAX;
+				}
+				else {
+					ch->window += credit;
+				}
+				rc = channel_flush(ch);
+			break;
+			case CHANNEL_FRAME_CLOSE:
+				/* Freed once no command of the channel runs. */
+				if(ch != NULL) {
+					ch->closing = 1;
+				}
+			break;
+			default:
+				rc = -1;
+			break;
+		}
+	}
+	memmove(m->in, m->in + pos, m->used - pos);
+	m->used -= pos;
+
+	if(rc < 0 && !m->dead) {
+		log_write(PMLOG_WARN, "Client %s broke channel protocol.",
+			m->conn->addr);
+	}
+	return rc;
+}
+
+/* Read from the connection of a channel.
+ */
+static int channel_read(ChannelMux *m)
+{
+	int nbytes;
+
+	nbytes = recv(m->conn->fd, (char *)m->in + m->used,
+		sizeof(m->in) - m->used, 0);
+	if(nbytes < 0 && session_blocked()) {
+		return 0;
+	}
+	if(nbytes <= 0) {
+		m->dead = 1;
+		return -1;
+	}
+	m->used += nbytes;
+	timer_add(&m->conn->idle, SESSION_IDLE);
+	return 0;
+}
+
+/* Give up on a channel whose client reads slower than its command
+ * writes, the command stops at its next deadline check.
+ */
+static void channel_full(Channel *ch)
+{
+	ch->full = 1;
+	ch->closing = 1;
+	ch->sess->deadline = timer_clock();
+	log_write(PMLOG_WARN, "Client %s fell behind on channel %u, closed.",
+		ch->sess->addr, ch->id);
+}
+
+/* Take the next command line of a channel, returns its length.
+ */
+static unsigned int channel_line(Channel *ch, char *line)
+{
+	unsigned char *eol;
+	unsigned int len;
+
+	eol = ch->inlen > 0 ? memchr(ch->in, '\n', ch->inlen) : NULL;
+	if(eol != NULL) {
+		len = eol - ch->in + 1;
+	}
+	else if(ch->inlen >= SESSION_LINE - 1) {
+		len = SESSION_LINE - 1;
+	}
+	else {
+		return 0;
+	}
+	if(len > SESSION_LINE - 1) {
+		len = SESSION_LINE - 1;
+	}
+
+	memcpy(line, ch->in, len);
+	line[len] = 0;
+	ch->inlen -= len;
+	memmove(ch->in, ch->in + len, ch->inlen);
+	ch->credit += len;
+	return len;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Set function that runs command lines of channels.
+ */
+void channel_init(ChannelRun run)
+{
+	channel_serve = run;
+}
+
+/* Switch a connection to channels after the current response.
+ */
+int channel_enable(const SOCKET fd)
+{
+	Session *s = session_get(fd);
+	ChannelMux *m;
+
+	if(s == NULL || s->chan != NULL || s->mux != NULL
+			|| channel_serve == NULL) {
+		return -1;
+	}
+	if((m = (ChannelMux *)mem_calloc(MEM_SESSIONS, 1,
+			sizeof(ChannelMux))) == NULL) {
+		return -1;
+	}
+	m->conn = s;
+
+	/* Anything sent after the command is framed already. */
+	memcpy(m->in, s->line, s->used);
+	m->used = s->used;
+	s->used = 0;
+	s->mux = m;
+	return 0;
+}
+
+/* Read frames from a connection.
+ */
+int channel_input(Session *conn)
+{
+	if(conn->mux == NULL || channel_read(conn->mux) < 0) {
+		return -1;
+	}
+	return channel_run(conn);
+}
+
+/* Handle input already read.
+ */
+int channel_run(Session *conn)
+{
+	ChannelMux *m = conn->mux;
+	unsigned long long span = trace_now();
+	unsigned char buf[4];
+	int progress = 1;
+	int i;
+
+	if(m == NULL) {
+		return 0;
+	}
+	if(channel_parse(m) < 0) {
+		return -1;
+	}
+
+	/* One line of each channel in turn, so none starves the others. */
+	while(progress && !global_done && !m->dead) {
+		progress = 0;
+		for(i = 0; i < CHANNEL_MAX && !global_done && !m->dead; i++) {
+			Channel *ch = m->chans[i];
+			char line[SESSION_LINE];
+			unsigned int len;
+
+			/* Output still waiting for credit holds the channel. */
+			if(ch == NULL || ch->closing || ch->queued > 0) {
+				continue;
+			}
+			if((len = channel_line(ch, line)) == 0) {
+				continue;
+			}
+			channel_serve(ch->sess, line, len, span);
+			channel_flush(ch);
+			if(ch->sess->quit) {
+				ch->closing = 1;
+			}
+			progress = 1;
+		}
+	}
+
+	for(i = 0; i < CHANNEL_MAX && !m->dead; i++) {
+		Channel *ch = m->chans[i];
+
+		if(ch == NULL) {
+			continue;
+		}
+		if(ch->closing) {
+			channel_free(ch, 1);
+			continue;
+		}
+
+		/* Give credit back once input drained or a quarter was used. */
+		if(ch->credit > 0 && (ch->inlen == 0
+				|| ch->credit >= CHANNEL_WINDOW / 4)) {
+			buf[0] = (ch->credit >> 24) & 0xff;
+			buf[1] = (ch->credit >> 16) & 0xff;
+			buf[2] = (ch->credit >> 8) & 0xff;
+			buf[3] = ch->credit & 0xff;
+			if(channel_frame(m, CHANNEL_FRAME_CREDIT, ch->id,
+					buf, 4) == 0) {
+				ch->credit = 0;
+			}
+		}
+	}
+	return m->dead ? -1 : 0;
+}
+
+/* Send output of a channel.
+ */
+int channel_send(Session *s, const void *buf, int len)
+{
+	Channel *ch = s->chan;
+	const unsigned char *p = (const unsigned char *)buf;
+	int left = len;
+
+	if(ch == NULL || ch->mux->dead || len < 0) {
+		return -1;
+	}
+	while(left > 0) {
+		unsigned int n = CHANNEL_QUEUE - ch->queued;
+
+		/* Nobody reads the output of a closing channel. */
+		if(ch->closing || n == 0) {
+			if(!ch->closing) {
+				channel_full(ch);
+			}
+			ch->dropped += left;
+			return -1;
+		}
+		if(n > (unsigned int)left) {
+			n = left;
+		}
+		if(ch->head + ch->queued + n > ch->size) {
+			memmove(ch->out, ch->out + ch->head, ch->queued);
+			ch->head = 0;
+			if(channel_grow(ch->sess, &ch->out, &ch->size,
+					ch->queued + n) < 0) {
+				ch->dropped += left;
+				return -1;
+			}
+		}
+		memcpy(ch->out + ch->head + ch->queued, p, n);
+		ch->queued += n;
+		p += n;
+		left -= n;
+		if(ch->queued >= CHANNEL_CHUNK && channel_flush(ch) < 0) {
+			return -1;
+		}
+	}
+	return len;
+}
+
+/* Close a channel, or every channel of a connection.
+ */
+void channel_close(Session *s)
+{
+	int i;
+
+	if(s == NULL) {
+		return;
+	}
+	if(s->chan != NULL) {
+		channel_free(s->chan, 1);
+		return;
+	}
+	if(s->mux != NULL) {
+		for(i = 0; i < CHANNEL_MAX; i++) {
+			if(s->mux->chans[i] != NULL) {
+				channel_free(s->mux->chans[i], 0);
+			}
+		}
+		mem_free(s->mux);
+		s->mux = NULL;
+	}
+}
+
+/* Show channels of the connection a client is on.
+ */
+int channel_show(const SOCKET fd)
+{
+	Session *s = session_get(fd);
+	ChannelMux *m;
+	char buf[256];
+	int i;
+
+	if(s == NULL || s->chan == NULL) {
+		out_send(fd, "Channels off.\r\n", 15);
+		return -1;
+	}
+	m = s->chan->mux;
+	snprintf(buf, sizeof(buf)-1,
+		"%-8s %-10s %-10s %-12s %-12s %s\r\n", "Channel", "Window",
+		"Queued", "Sent", "Received", "Dropped");
+	out_send(fd, buf, strlen(buf));
+	for(i = 0; i < CHANNEL_MAX; i++) {
+		Channel *ch = m->chans[i];
+
+		if(ch == NULL) {
+			continue;
+		}
+		snprintf(buf, sizeof(buf)-1,
+			"%-8u %-10ld %-10u %-12lu %-12lu %lu%s\r\n",
+			ch->id, ch->window, ch->queued, ch->sent, ch->received,
+			ch->dropped, ch == s->chan ? " *" : "");
+		out_send(fd, buf, strlen(buf));
+	}
+	return 0;
+}
+
+/* Get number of open channels.
+ */
+int channel_count(void)
+{
+	return total;
+}
@@ -0,0 +1,71 @@
+/*
+ * channel.h - Header for logical sessions multiplexed on a connection.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include "prs/network.h"
+#include "session.h"
+
+/* Frame header: type byte, two byte channel id and four byte length. */
+#define CHANNEL_HDRLEN 7
+/* Largest payload of a frame. */
+#define CHANNEL_CHUNK 16384
+/* Bytes each side may send on a channel before it needs credit. */
+#define CHANNEL_WINDOW 65536
+/* Most output a channel holds, a command writing more is cancelled and
+ * its channel closed. */
+#define CHANNEL_QUEUE (1024*1024)
+/* Most channels on one connection. */
+#define CHANNEL_MAX 64
+/* Logical sessions are numbered from here so they never clash with
+ * sockets. */
+#define CHANNEL_BASE 0x40000000
+
+/* Frame types, the same in both directions. */
+enum {
+	CHANNEL_FRAME_OPEN = 'O',
+	CHANNEL_FRAME_DATA = 'D',
+	CHANNEL_FRAME_CREDIT = 'W',
+	CHANNEL_FRAME_CLOSE = 'C'
+};
+
+/* Channel and connection state forward declarations. */
+struct Channel;
+struct ChannelMux;
+
+/* Function running a command line of a session. */
+typedef void (*ChannelRun)(Session *s, char *line, unsigned int len,
+	unsigned long long span);
+
+/* Set function that runs command lines of channels. */
+extern void channel_init(ChannelRun run);
+
+/* Switch a connection to channels after the current response. */
+extern int channel_enable(const SOCKET fd);
+
+/* Read frames from a connection, returns -1 if it must be closed. */
+extern int channel_input(Session *conn);
+
+/* Handle input already read, returns -1 if it must be closed. */
+extern int channel_run(Session *conn);
+
+/* Send output of a channel. */
+extern int channel_send(Session *s, const void *buf, int len);
+
+/* Close a channel, or every channel of a connection. */
+extern void channel_close(Session *s);
+
+/* Show channels of the connection a client is on. */
+extern int channel_show(const SOCKET fd);
+
+/* Get number of open channels. */
+extern int channel_count(void);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * main.c - Source for a command line client using libnetcom.
+ *
+ * Commands come from the command line or one per line on stdin. They
+ * are checked against the definitions the server reports, pipelined
+ * over a pool of connections and printed in the order given.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "netcom.h"
+
+/* Result slot definition and typedef. */
+struct Slot {
+	int done;
+	int status;
+	char *data;
+};
+typedef struct Slot Slot;
+
+static Slot *slots;
+static int slot_cnt;
+static int printed;
+static int failed;
+
+/* Print finished replies in order.
+ */
+static void flush_slots(void)
+{
+	while(printed < slot_cnt && slots[printed].done) {
+		Slot *s = &slots[printed++];
+
+		if(s->data != NULL) {
+			fputs(s->data, stdout);
+		}
+		if(s->status != NC_OK) {
+			fprintf(stderr, "Error: %s.\n", nc_strstatus(s->status));
+			failed = 1;
+		}
+		free(s->data);
+		s->data = NULL;
+	}
+	fflush(stdout);
+}
+
+/* Keep the reply of a command.
+ */
+static void on_reply(const NcReply *reply, void *arg)
+{
+	Slot *s = &slots[(long)arg];
+
+	s->status = reply->status;
+	s->data = (char *)malloc(reply->len + 1);
+	if(s->data != NULL) {
+		memcpy(s->data, reply->data, reply->len);
+		s->data[reply->len] = 0;
+	}
+	s->done = 1;
+}
+
+/* Check a line against its definition and queue it.
+ */
+static void queue_line(NcPool *pool, char *line)
+{
+	Argument args[16];
+	const Command *cmd;
+	char copy[NC_LINE];
+	char *tok;
+	long id;
+	int i;
+
+	line[strcspn(line, "\r\n")] = 0;
+	if(!*line) {
+		return;
+	}
+
+	if(slot_cnt % 64 == 0) {
+		Slot *tmp = (Slot *)realloc(slots, sizeof(Slot) * (slot_cnt + 64));
+		if(tmp == NULL) {
+			return;
+		}
+		slots = tmp;
+	}
+	id = slot_cnt++;
+	memset(&slots[id], 0, sizeof(Slot));
+
+	snprintf(copy, sizeof(copy), "%s", line);
+	tok = strtok(copy, " ");
+	cmd = tok != NULL ? nc_find(pool, tok) : NULL;
+	if(cmd == NULL) {
+		/* Unknown here, let the server decide. */
+		if(nc_send(pool, line, on_reply, (void *)id) < 0) {
+			slots[id].status = NC_ECLOSED;
+			slots[id].done = 1;
+		}
+		return;
+	}
+
+	for(i = 0; cmd->args[i] && i < 16; i++) {
+		/* Rest of the line goes as one argument, spaces and all. */
+		if(cmd->args[i] == 'r') {
+			tok = strtok(NULL, "\r\n");
+			args[i++].s = tok != NULL ? tok : "";
+			break;
+		}
+		if((tok = strtok(NULL, " ")) == NULL) {
+			break;
+		}
+		switch(cmd->args[i]) {
+			case 'd':
+				args[i].d = atoi(tok);
+			break;
+			case 'f':
+				args[i].f = atof(tok);
+			break;
+			default:
+				args[i].s = tok;
+			break;
+		}
+	}
+	if(cmd->args[i] || strtok(NULL, " ") != NULL) {
+		slots[id].status = NC_EBADARGS;
+		slots[id].done = 1;
+		return;
+	}
+	if(nc_call(pool, cmd->name, args, on_reply, (void *)id) < 0) {
+		slots[id].status = NC_EBADARGS;
+		slots[id].done = 1;
+	}
+}
+
+/* Show how to use this program.
+ */
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-h host] [-p port] [-c conns] "
+		"[command ...]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *host = "127.0.0.1";
+	unsigned short port = 0xBEEF;
+	char line[NC_LINE];
+	NcPool *pool;
+	int conns = 1;
+	int opt;
+
+	while((opt = getopt(argc, argv, "h:p:c:")) != -1) {
+		switch(opt) {
+			case 'h':
+				host = optarg;
+			break;
+			case 'p':
+				port = (unsigned short)atoi(optarg);
+			break;
+			case 'c':
+				conns = atoi(optarg);
+			break;
+			default:
+				usage(argv[0]);
+				return 1;
+			break;
+		}
+	}
+
+	pool = nc_open(host, port, conns);
+	if(pool == NULL) {
+		fprintf(stderr, "Error: Cannot connect to %s:%u.\n", host, port);
+		return 1;
+	}
+	if(nc_describe(pool) < 0) {
+		fprintf(stderr, "Warning: Cannot fetch command definitions.\n");
+	}
+
+	if(optind < argc) {
+		for(; optind < argc; optind++) {
+			snprintf(line, sizeof(line), "%s", argv[optind]);
+			queue_line(pool, line);
+			nc_poll(pool, 0);
+			flush_slots();
+		}
+	}
+	else {
+		while(fgets(line, sizeof(line), stdin) != NULL) {
+			queue_line(pool, line);
+			nc_poll(pool, 0);
+			flush_slots();
+		}
+	}
+	nc_wait(pool);
+	flush_slots();
+
+	nc_close(pool);
+	free(slots);
+	return failed;
+}
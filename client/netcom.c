@@ -0,0 +1,653 @@
+/*
+ * netcom.c - Source for the Network Commander client library.
+ *
+ * The server answers every line in order and ends each answer with its
+ * prompt, so commands can be pipelined: each connection keeps a queue
+ * of requests in flight and pops one whenever a prompt comes back.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <netdb.h>
+
+#include "netcom.h"
+
+/* Writes to a closed connection fail instead of raising SIGPIPE. */
+#ifdef MSG_NOSIGNAL
+#define NC_SENDFLAGS MSG_NOSIGNAL
+#else
+#define NC_SENDFLAGS 0
+#endif
+
+/* Request definition and typedef. */
+struct NcRequest {
+	NcCallback cb;
+	void *arg;
+};
+typedef struct NcRequest NcRequest;
+
+/* Connection definition and typedef. */
+struct NcConn {
+	SOCKET fd;
+	unsigned int head;
+	unsigned int count;
+	NcRequest req[NC_DEPTH+1];
+	char *buf;
+	unsigned int len;
+	unsigned int size;
+};
+typedef struct NcConn NcConn;
+
+/* Connection pool definition. */
+struct NcPool {
+	char *host;
+	unsigned short port;
+	NcConn *conns;
+	struct pollfd *fds;
+	int conn_cnt;
+	Command *cmds;
+	int cmd_cnt;
+};
+
+/* Exec result definition and typedef. */
+struct NcResult {
+	int done;
+	NcReply *reply;
+};
+typedef struct NcResult NcResult;
+
+static const char prompt[4] = { '>', '>', ' ', 0 };
+
+/* Connect to the server.
+ */
+static SOCKET nc_dial(const char *host, unsigned short port)
+{
+	struct addrinfo hints, *res, *ai;
+	SOCKET fd = INVALID_SOCKET;
+	char service[8];
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%u", port);
+	if(getaddrinfo(host, service, &hints, &res) != 0) {
+		return INVALID_SOCKET;
+	}
+	for(ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(fd == INVALID_SOCKET) {
+			continue;
+		}
+		if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		socket_close(fd);
+		fd = INVALID_SOCKET;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/* Queue a request on a connection.
+ */
+static void nc_push(NcConn *c, NcCallback cb, void *arg)
+{
+	NcRequest *r = &c->req[(c->head + c->count) % (NC_DEPTH+1)];
+
+	r->cb = cb;
+	r->arg = arg;
+	c->count++;
+}
+
+/* Finish the oldest request of a connection.
+ */
+static void nc_pop(NcConn *c, NcReply *reply)
+{
+	NcRequest r = c->req[c->head];
+
+	c->head = (c->head + 1) % (NC_DEPTH+1);
+	c->count--;
+	if(r.cb != NULL) {
+		r.cb(reply, r.arg);
+	}
+}
+
+/* Work out the status of a reply from its text.
+ */
+static int nc_status(const char *data, unsigned int len)
+{
+	static const struct {
+		const char *text;
+		int status;
+	} errors[] = {
+		{ "Bad command.\r\n", NC_EBADCMD },
+		{ "No command entered!\r\n", NC_EBADCMD },
+		{ "Bad argument(s).\r\n", NC_EBADARGS },
+		{ "Busy, try again later.\r\n", NC_EBUSY },
+		{ "Command timed out.\r\n", NC_ETIMEOUT }
+	};
+	static const char ambiguous[] = "Ambiguous command: ";
+	unsigned int i;
+
+	if(len >= sizeof(ambiguous) - 1
+			&& !memcmp(data, ambiguous, sizeof(ambiguous) - 1)) {
+		return NC_EBADCMD;
+	}
+	for(i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+		unsigned int n = strlen(errors[i].text);
+		if(len >= n && !memcmp(data + len - n, errors[i].text, n)
+				&& (errors[i].status == NC_ETIMEOUT || len == n)) {
+			return errors[i].status;
+		}
+	}
+	return NC_OK;
+}
+
+/* Fail every request of a connection and close it.
+ */
+static void nc_drop(NcConn *c)
+{
+	NcReply reply = { NC_ECLOSED, 0, "" };
+
+	if(c->fd != INVALID_SOCKET) {
+		socket_close(c->fd);
+		c->fd = INVALID_SOCKET;
+	}
+	while(c->count > 0) {
+		nc_pop(c, &reply);
+	}
+	c->len = 0;
+}
+
+/* Read from a connection and finish every complete reply.
+ */
+static int nc_read(NcConn *c)
+{
+	unsigned int start;
+	int nbytes;
+
+	if(c->size - c->len < 4096) {
+		unsigned int size = c->size ? c->size * 2 : 8192;
+		char *tmp = (char *)realloc(c->buf, size);
+		if(tmp == NULL) {
+			return -1;
+		}
+		c->buf = tmp;
+		c->size = size;
+	}
+
+	nbytes = recv(c->fd, c->buf + c->len, c->size - c->len - 1, 0);
+	if(nbytes <= 0) {
+		return -1;
+	}
+	start = c->len >= sizeof(prompt) ? c->len - sizeof(prompt) + 1 : 0;
+	c->len += nbytes;
+
+	while(c->len - start >= sizeof(prompt)) {
+		char *end = memchr(c->buf + start, prompt[0],
+			c->len - start - sizeof(prompt) + 1);
+		NcReply reply;
+		unsigned int used;
+
+		if(end == NULL) {
+			break;
+		}
+		if(memcmp(end, prompt, sizeof(prompt))) {
+			start = end - c->buf + 1;
+			continue;
+		}
+
+		reply.len = end - c->buf;
+		reply.data = c->buf;
+		c->buf[reply.len] = 0;
+		reply.status = nc_status(reply.data, reply.len);
+		if(c->count > 0) {
+			nc_pop(c, &reply);
+		}
+
+		used = reply.len + sizeof(prompt);
+		memmove(c->buf, c->buf + used, c->len - used);
+		c->len -= used;
+		start = 0;
+	}
+	return 0;
+}
+
+/* Send a whole buffer.
+ */
+static int nc_write(SOCKET fd, const char *buf, unsigned int len)
+{
+	unsigned int total = 0;
+
+	while(total < len) {
+		int rc = send(fd, buf + total, len - total, NC_SENDFLAGS);
+		if(rc <= 0) {
+			return -1;
+		}
+		total += rc;
+	}
+	return 0;
+}
+
+/* Connect a dropped connection of a pool again, returns it or NULL.
+ */
+static NcConn *nc_redial(NcPool *pool)
+{
+	int i;
+
+	for(i = 0; i < pool->conn_cnt; i++) {
+		NcConn *c = &pool->conns[i];
+
+		if(c->fd != INVALID_SOCKET) {
+			continue;
+		}
+		if((c->fd = nc_dial(pool->host, pool->port)) == INVALID_SOCKET) {
+			return NULL;
+		}
+		nc_push(c, NULL, NULL);
+		return c;
+	}
+	return NULL;
+}
+
+/* Keep the reply of nc_exec().
+ */
+static void nc_keep(const NcReply *reply, void *arg)
+{
+	NcResult *res = (NcResult *)arg;
+
+	res->reply = (NcReply *)malloc(sizeof(NcReply));
+	if(res->reply != NULL) {
+		res->reply->status = reply->status;
+		res->reply->len = reply->len;
+		res->reply->data = (char *)malloc(reply->len + 1);
+		if(res->reply->data != NULL) {
+			memcpy(res->reply->data, reply->data, reply->len);
+			res->reply->data[reply->len] = 0;
+		}
+		else {
+			free(res->reply);
+			res->reply = NULL;
+		}
+	}
+	res->done = 1;
+}
+
+/* Copy part of a string.
+ */
+static char *nc_strndup(const char *s, unsigned int len)
+{
+	char *copy = (char *)malloc(len + 1);
+
+	if(copy != NULL) {
+		memcpy(copy, s, len);
+		copy[len] = 0;
+	}
+	return copy;
+}
+
+/* Free fetched command definitions.
+ */
+static void nc_forget(NcPool *pool)
+{
+	int i;
+
+	for(i = 0; i < pool->cmd_cnt; i++) {
+		free((char *)pool->cmds[i].name);
+		free((char *)pool->cmds[i].args);
+		free((char *)pool->cmds[i].help);
+	}
+	free(pool->cmds);
+	pool->cmds = NULL;
+	pool->cmd_cnt = 0;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Open a pool of connections to a server.
+ */
+NcPool *nc_open(const char *host, unsigned short port, int conns)
+{
+	NcPool *pool;
+	int i;
+
+	if(conns < 1) {
+		conns = 1;
+	}
+	pool = (NcPool *)calloc(1, sizeof(NcPool));
+	if(pool == NULL) {
+		return NULL;
+	}
+	pool->conns = (NcConn *)calloc(conns, sizeof(NcConn));
+	pool->fds = (struct pollfd *)calloc(conns, sizeof(struct pollfd));
+	if(pool->conns == NULL || pool->fds == NULL) {
+		free(pool->conns);
+		free(pool->fds);
+		free(pool);
+		return NULL;
+	}
+	pool->conn_cnt = conns;
+	pool->port = port;
+	for(i = 0; i < conns; i++) {
+		pool->conns[i].fd = INVALID_SOCKET;
+	}
+	if((pool->host = nc_strndup(host, strlen(host))) == NULL) {
+		nc_close(pool);
+		return NULL;
+	}
+
+	for(i = 0; i < conns; i++) {
+		NcConn *c = &pool->conns[i];
+
+		c->fd = nc_dial(host, port);
+		if(c->fd == INVALID_SOCKET) {
+			nc_close(pool);
+			return NULL;
+		}
+
+		/* The greeting prompt answers no command. */
+		nc_push(c, NULL, NULL);
+	}
+	return pool;
+}
+
+/* Close every connection of a pool.
+ */
+void nc_close(NcPool *pool)
+{
+	int i;
+
+	if(pool == NULL) {
+		return;
+	}
+	for(i = 0; i < pool->conn_cnt; i++) {
+		nc_drop(&pool->conns[i]);
+		free(pool->conns[i].buf);
+	}
+	nc_forget(pool);
+	free(pool->conns);
+	free(pool->fds);
+	free(pool->host);
+	free(pool);
+}
+
+/* Fetch command definitions from the server with 'help'.
+ */
+int nc_describe(NcPool *pool)
+{
+	NcReply *reply;
+	char *line, *next;
+	int total = 0;
+
+	reply = nc_exec(pool, "help");
+	if(reply == NULL || reply->status != NC_OK) {
+		nc_free(reply);
+		return -1;
+	}
+
+	nc_forget(pool);
+	for(line = reply->data; *line; line = next) {
+		char *open, *close, *name_end;
+		Command *tmp;
+
+		next = strstr(line, "\r\n");
+		next = next != NULL ? next + 2 : line + strlen(line);
+
+		/* Lines look like: name - [args ]: help */
+		open = strchr(line, '[');
+		close = open != NULL ? strchr(open, ']') : NULL;
+		name_end = strchr(line, ' ');
+		if(close == NULL || close > next || name_end == NULL) {
+			continue;
+		}
+
+		tmp = (Command *)realloc(pool->cmds,
+			sizeof(Command) * (total + 1));
+		if(tmp == NULL) {
+			break;
+		}
+		pool->cmds = tmp;
+		tmp = &pool->cmds[total];
+		tmp->name = nc_strndup(line, name_end - line);
+		tmp->args = nc_strndup(open + 1, strcspn(open + 1, " ]"));
+		tmp->help = nc_strndup(close + 3 < next ? close + 3 : close,
+			next - 2 > close + 3 ? (next - 2) - (close + 3) : 0);
+		tmp->func = NULL;
+		tmp->timeout = 0;
+		tmp->flags = 0;
+		pool->cmd_cnt = ++total;
+	}
+	nc_free(reply);
+	return total;
+}
+
+/* Find a command fetched by nc_describe().
+ */
+const Command *nc_find(NcPool *pool, const char *name)
+{
+	int i;
+
+	for(i = 0; i < pool->cmd_cnt; i++) {
+		if(!strcmp(pool->cmds[i].name, name)) {
+			return &pool->cmds[i];
+		}
+	}
+	return NULL;
+}
+
+/* Queue a raw command line.
+ */
+int nc_send(NcPool *pool, const char *line, NcCallback cb, void *arg)
+{
+	char buf[NC_LINE+1];
+	NcConn *best;
+	int len, live, i;
+
+	len = snprintf(buf, sizeof(buf) - 1, "%s", line);
+	if(len <= 0 || len >= NC_LINE) {
+		return -1;
+	}
+	if(buf[len-1] != '\n') {
+		buf[len++] = '\n';
+	}
+
+	for(;;) {
+		best = NULL;
+		live = 0;
+		for(i = 0; i < pool->conn_cnt; i++) {
+			NcConn *c = &pool->conns[i];
+			if(c->fd == INVALID_SOCKET) {
+				continue;
+			}
+			live++;
+			if(c->count < NC_DEPTH
+					&& (best == NULL || c->count < best->count)) {
+				best = c;
+			}
+		}
+
+		/* Every connection was dropped, nothing would ever finish. */
+		if(best == NULL && live == 0
+				&& (best = nc_redial(pool)) == NULL) {
+			return -1;
+		}
+		if(best != NULL) {
+			break;
+		}
+		if(nc_poll(pool, -1) < 0) {
+			return -1;
+		}
+	}
+
+	if(nc_write(best->fd, buf, len) < 0) {
+		nc_drop(best);
+		return -1;
+	}
+	nc_push(best, cb, arg);
+	return 0;
+}
+
+/* Queue a command with typed arguments.
+ */
+int nc_call(NcPool *pool, const char *name, const Argument *args,
+	NcCallback cb, void *arg)
+{
+	const Command *cmd;
+	char line[NC_LINE];
+	int len, i;
+
+	if(pool->cmds == NULL && nc_describe(pool) < 0) {
+		return -1;
+	}
+	if((cmd = nc_find(pool, name)) == NULL) {
+		return -1;
+	}
+
+	len = snprintf(line, sizeof(line), "%s", cmd->name);
+	for(i = 0; cmd->args[i] && len < (int)sizeof(line); i++) {
+		switch(cmd->args[i]) {
+			case 's':
+				if(args == NULL || args[i].s == NULL || !*args[i].s
+						|| strpbrk(args[i].s, " \r\n") != NULL) {
+					return -1;
+				}
+				len += snprintf(line + len, sizeof(line) - len,
+					" %s", args[i].s);
+			break;
+			case 'd':
+				len += snprintf(line + len, sizeof(line) - len,
+					" %d", args != NULL ? args[i].d : 0);
+			break;
+			case 'f':
+				len += snprintf(line + len, sizeof(line) - len,
+					" %g", args != NULL ? args[i].f : 0.0);
+			break;
+			case 'r':
+				/* Rest of the line, spaces are part of it. */
+				if(args == NULL || args[i].s == NULL
+						|| strpbrk(args[i].s, "\r\n") != NULL) {
+					return -1;
+				}
+				if(*args[i].s) {
+					len += snprintf(line + len, sizeof(line) - len,
+						" %s", args[i].s);
+				}
+			break;
+			default:
+				return -1;
+			break;
+		}
+	}
+	if(len >= (int)sizeof(line)) {
+		return -1;
+	}
+	return nc_send(pool, line, cb, arg);
+}
+
+/* Process replies for up to timeout ms.
+ */
+int nc_poll(NcPool *pool, int timeout)
+{
+	struct pollfd *fds = pool->fds;
+	int total = 0, inflight = 0;
+	int i, j;
+
+	for(i = 0; i < pool->conn_cnt; i++) {
+		NcConn *c = &pool->conns[i];
+		if(c->fd != INVALID_SOCKET && c->count > 0) {
+			fds[total].fd = c->fd;
+			fds[total].events = POLLIN;
+			fds[total].revents = 0;
+			++total;
+		}
+	}
+	if(!total) {
+		return 0;
+	}
+	if(poll(fds, total, timeout) < 0) {
+		return -1;
+	}
+
+	for(i = 0, j = 0; i < pool->conn_cnt && j < total; i++) {
+		NcConn *c = &pool->conns[i];
+		if(c->fd != fds[j].fd) {
+			continue;
+		}
+		if(fds[j].revents && nc_read(c) < 0) {
+			nc_drop(c);
+		}
+		++j;
+	}
+
+	for(i = 0; i < pool->conn_cnt; i++) {
+		inflight += pool->conns[i].count;
+	}
+	return inflight;
+}
+
+/* Wait until every command in flight has finished.
+ */
+int nc_wait(NcPool *pool)
+{
+	int rc;
+
+	while((rc = nc_poll(pool, -1)) > 0);
+	return rc;
+}
+
+/* Run a command line and wait for its reply.
+ */
+NcReply *nc_exec(NcPool *pool, const char *line)
+{
+	NcResult res = { 0, NULL };
+
+	if(nc_send(pool, line, nc_keep, &res) < 0) {
+		return NULL;
+	}
+	while(!res.done) {
+		if(nc_poll(pool, -1) < 0) {
+			break;
+		}
+	}
+	return res.reply;
+}
+
+/* Free a reply returned by nc_exec().
+ */
+void nc_free(NcReply *reply)
+{
+	if(reply != NULL) {
+		free(reply->data);
+		free(reply);
+	}
+}
+
+/* Get a readable name of a status code.
+ */
+const char *nc_strstatus(int status)
+{
+	switch(status) {
+		case NC_OK:
+			return "ok";
+		case NC_EBADCMD:
+			return "bad command";
+		case NC_EBADARGS:
+			return "bad arguments";
+		case NC_EBUSY:
+			return "busy";
+		case NC_ETIMEOUT:
+			return "timed out";
+		case NC_ECLOSED:
+			return "connection closed";
+	}
+	return "unknown";
+}
@@ -0,0 +1,81 @@
+/*
+ * netcom.h - Header for the Network Commander client library.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _NETCOM_H_
+#define _NETCOM_H_
+
+#include "cmd.h"
+
+/* Most commands in flight on one connection. */
+#define NC_DEPTH 64
+/* Longest command line sent to the server. */
+#define NC_LINE 256
+
+/* Reply status codes. */
+enum {
+	NC_OK,
+	NC_EBADCMD,
+	NC_EBADARGS,
+	NC_EBUSY,
+	NC_ETIMEOUT,
+	NC_ECLOSED
+};
+
+/* Reply definition and typedef. */
+struct NcReply {
+	int status;
+	unsigned int len;
+	char *data;
+};
+typedef struct NcReply NcReply;
+
+/* Callback for a finished command, reply is freed after it returns. */
+typedef void (*NcCallback)(const NcReply *reply, void *arg);
+
+/* Connection pool forward declaration. */
+struct NcPool;
+typedef struct NcPool NcPool;
+
+/* Open a pool of connections to a server. */
+extern NcPool *nc_open(const char *host, unsigned short port, int conns);
+
+/* Close every connection of a pool, pending callbacks get NC_ECLOSED. */
+extern void nc_close(NcPool *pool);
+
+/* Fetch command definitions from the server with 'help'. */
+extern int nc_describe(NcPool *pool);
+
+/* Find a command fetched by nc_describe(). */
+extern const Command *nc_find(NcPool *pool, const char *name);
+
+/* Queue a raw command line, callback runs when its reply arrives. A
+ * dropped connection is dialed again when no other one is left. */
+extern int nc_send(NcPool *pool, const char *line, NcCallback cb,
+	void *arg);
+
+/* Queue a command with typed arguments checked against its definition. */
+extern int nc_call(NcPool *pool, const char *name, const Argument *args,
+	NcCallback cb, void *arg);
+
+/* Process replies for up to timeout ms, returns commands in flight. */
+extern int nc_poll(NcPool *pool, int timeout);
+
+/* Wait until every command in flight has finished. */
+extern int nc_wait(NcPool *pool);
+
+/* Run a command line and wait for its reply. */
+extern NcReply *nc_exec(NcPool *pool, const char *line);
+
+/* Free a reply returned by nc_exec(). */
+extern void nc_free(NcReply *reply);
+
+/* Get a readable name of a status code. */
+extern const char *nc_strstatus(int status);
+
+#endif
@@ -10,19 +10,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <time.h>
 
-#if defined(__linux)
-#include <unistd.h>
-#endif
-
-#include "prs/abuffer.h"
 #include "plugin.h"
 #include "parse.h"
+#include "output.h"
+#include "trace.h"
+#include "log.h"
+#include "session.h"
+#include "limit.h"
+#include "capture.h"
+#include "upgrade.h"
+#include "host.h"
+#include "store.h"
+#include "channel.h"
+#include "mem.h"
+#include "batch.h"
 
-/* Tell program that it's finished. */
-extern int global_done;
 extern int plugins_loaded;
 
 /* Lookup table for date (month). */
@@ -50,39 +56,75 @@ CMD_DEF(sdir);
 CMD_DEF(cdir);
 CMD_DEF(run);
 CMD_DEF(mods);
+CMD_DEF(comp);
+CMD_DEF(trace);
+CMD_DEF(log);
+CMD_DEF(limit);
+CMD_DEF(stats);
+CMD_DEF(capture);
+CMD_DEF(upgrade);
+CMD_DEF(complete);
+CMD_DEF(channel);
+CMD_DEF(mem);
+CMD_DEF(batch);
 CMD_DEF(exit);
 
 static Command cmds[] = {
 	CMD_ADD1(help, "", "Display command information."),
 	CMD_ADD1(when, "s", "Display time/date, just type 'time' or 'date'."),
-	CMD_ADD1(list, "", "List current working directory."),
+	CMD_ADD3(list, "", "List current working directory.", 5000),
 	CMD_ADD1(sdir, "s", "Switch to a different directory."),
 	CMD_ADD2(pdir, "", "Previous working directory.", sdir),
 	CMD_ADD1(cdir, "", "Current working directory."),
 	CMD_ADD1(run, "s", "Launch a module from plugins directory."),
-	CMD_ADD1(mods, "s", "Show/Reload modules, "
-			"just type 'show' or 'reload'."),
-	CMD_ADD1(exit, "", "Exit this application.")
+	CMD_ADD4(mods, "s", "Show/Reload modules, "
+			"just type 'show' or 'reload'.", 0, CMD_EXACT),
+	CMD_ADD1(comp, "s", "Compress responses, "
+			"just type 'on', 'off' or 'stats'."),
+	CMD_ADD1(trace, "s", "Trace requests, just type 'on', 'off', "
+			"'dump' or a sample rate."),
+	CMD_ADD1(log, "s", "Set log level or show stats, "
+			"just type a level or 'stats'."),
+	CMD_ADD1(limit, "sff", "Set rate limit of a command, "
+			"type name, rate per second and burst."),
+	CMD_ADD1(stats, "", "Show server counters."),
+	CMD_ADD1(capture, "s", "Capture sessions for replay, "
+			"just type 'start', 'full' or 'stop'."),
+	CMD_ADD4(upgrade, "s", "Hand over to a new binary, "
+			"just type 'listen' or 'all'.", 0, CMD_EXACT),
+	CMD_ADD1(complete, "s", "List commands starting with a prefix."),
+	CMD_ADD1(channel, "s", "Carry many sessions on this connection, "
+			"just type 'on' or 'stats'."),
+	CMD_ADD1(mem, "sr", "Show memory or set session cap in KiB, "
+			"type 'show', 'sessions', 'commands', a cap or 'store' and a "
+			"limit."),
+	CMD_ADD1(batch, "sr", "Run commands in one response, type 'do' or "
+			"'all' and commands split by ';', a script, 'list' or 'reload'."),
+	CMD_ADD4(exit, "", "Close this session.", 0, CMD_EXACT)
 };
 static int CMD_CNT = sizeof(cmds) / sizeof(cmds[0]);
 
 CMD_DEF(help)
 {
-	AppendBuffer *ab;
-	char buf[256];
-	char *tmp;
-	int len;
+	unsigned int size = 1;
+	unsigned int len = 0;
+	char *buf;
 	int i;
 
-	ab = ab_init();
 	for(i = 0; i < CMD_CNT; i++) {
-		len = snprintf(buf, sizeof(buf) - 1, "%-10s - [%-5s]: %s\r\n",
+		size += snprintf(NULL, 0, "%-10s - [%-5s]: %s\r\n",
+			cmds[i].name, cmds[i].args, cmds[i].help);
+	}
+	if((buf = (char *)pm_malloc(PMMEM_HELP, size)) == NULL) {
+		out_send(fd, "Out of memory.\r\n", 16);
+		return 1;
+	}
+	for(i = 0; i < CMD_CNT; i++) {
+		len += snprintf(buf + len, size - len, "%-10s - [%-5s]: %s\r\n",
 			cmds[i].name, cmds[i].args, cmds[i].help);
-		ab_append(ab, buf, len);
 	}
-	tmp = (char *)ab_getdata(ab);
-	send(fd, tmp, strlen(tmp), 0);
-	ab_free(ab);
+	out_send(fd, buf, len);
+	pm_free(buf);
 
 	pm_register_help(fd);
 	return 0;
@@ -109,27 +151,28 @@ CMD_DEF(when)
 		snprintf(buf, sizeof(buf)-1,
 			"Sorry I'm having trouble, what do you mean?\r\n");
 	}
-	send(fd, buf, strlen(buf), 0);
+	out_send(fd, buf, strlen(buf));
 	return 0;
 }
 
 CMD_DEF(list)
 {
-	char buf[512];
+	Session *s = session_get(fd);
+	char buf[SESSION_PATH+64];
 	struct dirent *p;
 	DIR *dir;
 
-	if((dir = opendir(".")) == NULL) {
+	if(s == NULL || (dir = opendir(s->cwd)) == NULL) {
 		snprintf(buf, sizeof(buf)-1, "Cannot open directory: %s\r\n",
-			args != NULL ? args[0].s : ".");
-		send(fd, buf, strlen(buf), 0);
+			s != NULL ? s->cwd : ".");
+		out_send(fd, buf, strlen(buf));
 		return 1;
 	}
 
-	while((p = readdir(dir)) != NULL) {
+	while((p = readdir(dir)) != NULL && !session_cancelled(fd)) {
 		if((strcmp(p->d_name, ".") && strcmp(p->d_name, "..")) != 0) {
 			snprintf(buf, sizeof(buf)-1, "%s\r\n", p->d_name);
-			send(fd, buf, strlen(buf), 0);
+			out_send(fd, buf, strlen(buf));
 		}
 	}
 	closedir(dir);
@@ -138,25 +181,33 @@ CMD_DEF(list)
 
 CMD_DEF(sdir)
 {
+	const char *path = args != NULL ? args[0].s : "..";
 	char buf[512];
+
+	/* Each session has a directory of its own, the server never moves. */
+	if(session_chdir(session_get(fd), path) < 0) {
+		snprintf(buf, sizeof(buf)-1, "Cannot change to %s.\r\n", path);
+		out_send(fd, buf, strlen(buf));
+		return 1;
+	}
 	if(args == NULL) {
 		snprintf(buf, sizeof(buf)-1, "Previous directory.\r\n");
 	}
 	else {
 		snprintf(buf, sizeof(buf)-1, "Directory: %s\r\n", args[0].s);
 	}
-	send(fd, buf, strlen(buf), 0);
-	return chdir(args != NULL ? args[0].s : "..");
+	out_send(fd, buf, strlen(buf));
+	return 0;
 }
 
 CMD_DEF(cdir)
 {
+	Session *s = session_get(fd);
 	char output[2048];
-	char buf[1024];
 
-	getcwd(buf, sizeof(buf)-1);
-	snprintf(output, sizeof(output)-1, "Current directory: %s\r\n", buf);
-	send(fd, output, strlen(output), 0);
+	snprintf(output, sizeof(output)-1, "Current directory: %s\r\n",
+		s != NULL ? s->cwd : ".");
+	out_send(fd, output, strlen(output));
 	return 0;
 }
 
@@ -166,10 +217,13 @@ CMD_DEF(run)
 
 	plugin = pm_find(args[0].s);
 	if(plugin != NULL) {
+		if(pm_gettimeout(plugin)) {
+			session_deadline(fd, pm_gettimeout(plugin));
+		}
 		pm_exec(plugin, fd);
 		return 0;
 	}
-	send(fd, "Cannot find module.\r\n", 21, 0);
+	out_send(fd, "Cannot find module.\r\n", 21);
 	return 1;
 }
 
@@ -180,42 +234,424 @@ CMD_DEF(mods)
 	}
 	else if(!strncmp(args[0].s, "start", 6)) {
 		if(!plugins_loaded) {
+			host_init("plugin-sdk");
 			pm_init("plugin-sdk");
-			pm_register(fd);
-			send(fd, "Plugins started!\r\n", 18, 0);
+			pm_register(INVALID_SOCKET);
+			out_send(fd, "Plugins started!\r\n", 18);
 			plugins_loaded = 1;
 			return 0;
 		}
-		send(fd, "Plugins loaded already!\r\n", 25, 0);
+		out_send(fd, "Plugins loaded already!\r\n", 25);
 	}
 	else if(!strncmp(args[0].s, "stop", 5)) {
 		if(plugins_loaded) {
 			pm_deinit();
-			send(fd, "Plugins stopped!\r\n", 18, 0);
+			host_deinit();
+			out_send(fd, "Plugins stopped!\r\n", 18);
 			plugins_loaded = 0;
 			return 0;
 		}
-		send(fd, "Plugins unloaded already!\r\n", 27, 0);
+		out_send(fd, "Plugins unloaded already!\r\n", 27);
 	}
 	else if(!strncmp(args[0].s, "reload", 7)) {
 		if(plugins_loaded) {
 			pm_deinit();
+			host_deinit();
+			host_init("plugin-sdk");
 			pm_init("plugin-sdk");
-			pm_register(fd);
-			send(fd, "Plugins reloaded!\r\n", 19, 0);
+			pm_register(INVALID_SOCKET);
+			out_send(fd, "Plugins reloaded!\r\n", 19);
 			return 0;
 		}
-		send(fd, "Plugins not loaded use 'start'.\r\n", 33, 0);
+		out_send(fd, "Plugins not loaded use 'start'.\r\n", 33);
 	}
 	else {
-		send(fd, "Invalid option.\r\n", 17, 0);
+		out_send(fd, "Invalid option.\r\n", 17);
 	}
 	return 1;
 }
 
+CMD_DEF(comp)
+{
+	char buf[512];
+	OutStats st;
+
+	if(!strncmp(args[0].s, "on", 3)) {
+		out_send(fd, "Compression on.\r\n", 17);
+		return out_setmode(fd, OUT_FRAMED) < 0;
+	}
+	else if(!strncmp(args[0].s, "off", 4)) {
+		out_send(fd, "Compression off.\r\n", 18);
+		return out_setmode(fd, OUT_RAW) < 0;
+	}
+	else if(!strncmp(args[0].s, "stats", 6)) {
+		out_stats(fd, &st);
+		snprintf(buf, sizeof(buf)-1,
+			"Compression: %s, threshold %d bytes\r\n"
+			"Responses  : %lu (%lu compressed)\r\n"
+			"Bytes      : %lu in, %lu out (ratio %.2f)\r\n"
+			"CPU time   : %.3f ms\r\n",
+			out_getmode(fd) == OUT_FRAMED ? "on" : "off",
+			OUT_THRESHOLD, st.responses, st.compressed,
+			st.bytes_in, st.bytes_out,
+			st.bytes_in ? (double)st.bytes_out / st.bytes_in : 1.0,
+			st.cpu * 1000.0);
+		out_send(fd, buf, strlen(buf));
+		return 0;
+	}
+	out_send(fd, "Invalid option.\r\n", 17);
+	return 1;
+}
+
+CMD_DEF(trace)
+{
+	char buf[512];
+	int total;
+
+	if(!strncmp(args[0].s, "on", 3)) {
+		trace_enable(fd, 1);
+		out_send(fd, "Tracing on.\r\n", 13);
+	}
+	else if(!strncmp(args[0].s, "off", 4)) {
+		trace_enable(fd, 0);
+		out_send(fd, "Tracing off.\r\n", 14);
+	}
+	else if(!strncmp(args[0].s, "dump", 5)) {
+		total = trace_dump(TRACE_FILE);
+		if(total < 0) {
+			snprintf(buf, sizeof(buf)-1, "Cannot write %s.\r\n",
+				TRACE_FILE);
+			out_send(fd, buf, strlen(buf));
+			return 1;
+		}
+		snprintf(buf, sizeof(buf)-1, "Wrote %d events to %s.\r\n",
+			total, TRACE_FILE);
+		out_send(fd, buf, strlen(buf));
+	}
+	else if(isdigit((unsigned char)args[0].s[0])) {
+		total = atoi(args[0].s);
+		trace_sample(total);
+		if(total > 0) {
+			snprintf(buf, sizeof(buf)-1,
+				"Tracing 1 in %d requests.\r\n", total);
+		}
+		else {
+			snprintf(buf, sizeof(buf)-1, "Sampling off.\r\n");
+		}
+		out_send(fd, buf, strlen(buf));
+	}
+	else {
+		out_send(fd, "Invalid option.\r\n", 17);
+		return 1;
+	}
+	return 0;
+}
+
+CMD_DEF(log)
+{
+	char buf[512];
+	LogStats st;
+	int level;
+
+	if(!strncmp(args[0].s, "stats", 6)) {
+		log_stats(&st);
+		snprintf(buf, sizeof(buf)-1,
+			"Written    : %lu\r\n"
+			"Dropped    : %lu\r\n"
+			"Suppressed : %lu\r\n",
+			st.written, st.dropped, st.suppressed);
+		out_send(fd, buf, strlen(buf));
+		return 0;
+	}
+
+	level = log_level(args[0].s);
+	if(level < 0) {
+		out_send(fd, "Invalid option, use debug, info, warn or error.\r\n",
+			50);
+		return 1;
+	}
+	log_setlevel(level);
+	snprintf(buf, sizeof(buf)-1, "Log level %s.\r\n", args[0].s);
+	out_send(fd, buf, strlen(buf));
+	return 0;
+}
+
+CMD_DEF(limit)
+{
+	char buf[512];
+
+	if(limit_rule(args[0].s, args[1].f, args[2].f) < 0) {
+		out_send(fd, "Invalid limit.\r\n", 16);
+		return 1;
+	}
+	snprintf(buf, sizeof(buf)-1, "Limit %s: %.2f/s, burst %.0f.\r\n",
+		args[0].s, args[1].f, args[2].f);
+	out_send(fd, buf, strlen(buf));
+	return 0;
+}
+
+CMD_DEF(stats)
+{
+	char buf[1024];
+	LimitStats st;
+	StoreStats ss;
+	HostStats hs;
+
+	limit_stats(&st);
+	snprintf(buf, sizeof(buf)-1,
+		"Sessions          : %d of %d\r\n"
+		"Channels          : %d\r\n"
+		"Accepted          : %lu\r\n"
+		"Rejected sessions : %lu\r\n"
+		"Rejected connects : %lu\r\n"
+		"Commands          : %lu\r\n"
+		"Rejected commands : %lu\r\n"
+		"Rejected memory   : %lu\r\n",
+		session_count() - channel_count(), LIMIT_SESSIONS,
+		channel_count(), st.accepted,
+		st.rejected_sessions, st.rejected_connects,
+		st.commands, st.rejected_commands, st.rejected_memory);
+	out_send(fd, buf, strlen(buf));
+
+	store_stats(&ss);
+	snprintf(buf, sizeof(buf)-1,
+		"Store keys        : %lu\r\n"
+		"Store bytes       : %lu of %lu\r\n"
+		"Store hits        : %lu (%lu misses)\r\n"
+		"Store expired     : %lu\r\n"
+		"Store rejected    : %lu\r\n",
+		ss.keys, ss.bytes, ss.limit, ss.hits, ss.misses,
+		ss.expired, ss.rejected);
+	out_send(fd, buf, strlen(buf));
+
+	host_stats(&hs);
+	if(hs.hosts > 0) {
+		snprintf(buf, sizeof(buf)-1,
+			"Plugin hosts      : %u\r\n"
+			"Host calls        : %lu\r\n"
+			"Host failures     : %lu\r\n"
+			"Host restarts     : %lu\r\n",
+			hs.hosts, hs.calls, hs.crashes, hs.restarts);
+		out_send(fd, buf, strlen(buf));
+	}
+	return 0;
+}
+
+CMD_DEF(capture)
+{
+	char buf[512];
+	int flags = 0;
+	long total;
+
+	if(!strncmp(args[0].s, "start", 6)
+			|| !strncmp(args[0].s, "full", 5)) {
+		if(!strncmp(args[0].s, "full", 5)) {
+			flags |= CAPTURE_RESPONSES;
+		}
+		if(capture_start(CAPTURE_FILE, flags) < 0) {
+			snprintf(buf, sizeof(buf)-1,
+				"Cannot capture to %s.\r\n", CAPTURE_FILE);
+			out_send(fd, buf, strlen(buf));
+			return 1;
+		}
+		capture_open(session_get(fd));
+		snprintf(buf, sizeof(buf)-1, "Capturing to %s.\r\n",
+			CAPTURE_FILE);
+		out_send(fd, buf, strlen(buf));
+	}
+	else if(!strncmp(args[0].s, "stop", 5)) {
+		total = capture_stop();
+		if(total < 0) {
+			out_send(fd, "Not capturing.\r\n", 16);
+			return 1;
+		}
+		snprintf(buf, sizeof(buf)-1, "Captured %ld records.\r\n",
+			total);
+		out_send(fd, buf, strlen(buf));
+	}
+	else {
+		out_send(fd, "Invalid option.\r\n", 17);
+		return 1;
+	}
+	return 0;
+}
+
+CMD_DEF(upgrade)
+{
+	int mode;
+
+	if(!strncmp(args[0].s, "listen", 7)) {
+		mode = UPGRADE_LISTENER;
+	}
+	else if(!strncmp(args[0].s, "all", 4)) {
+		mode = UPGRADE_SESSIONS;
+	}
+	else {
+		out_send(fd, "Invalid option.\r\n", 17);
+		return 1;
+	}
+	if(upgrade_request(mode) != 0) {
+		out_send(fd, "Upgrade not supported.\r\n", 24);
+		return 1;
+	}
+	out_send(fd, "Upgrade scheduled.\r\n", 20);
+	return 0;
+}
+
+CMD_DEF(complete)
+{
+	return parse_complete(fd, args[0].s) > 0 ? 0 : 1;
+}
+
+CMD_DEF(channel)
+{
+	if(!strncmp(args[0].s, "on", 3)) {
+		if(channel_enable(fd) < 0) {
+			out_send(fd, "Channels on already.\r\n", 22);
+			return 1;
+		}
+		out_send(fd, "Channels on.\r\n", 14);
+		return 0;
+	}
+	else if(!strncmp(args[0].s, "stats", 6)) {
+		return channel_show(fd) < 0;
+	}
+	out_send(fd, "Invalid option.\r\n", 17);
+	return 1;
+}
+
+CMD_DEF(mem)
+{
+	char buf[256];
+	unsigned int pos = 0;
+	StoreStats ss;
+	MemStats ms;
+	Session *s;
+	int i;
+
+	if(!strncmp(args[0].s, "store", 6)) {
+		if(*args[1].s != '\0') {
+			if(!isdigit((unsigned char)args[1].s[0])
+					|| (i = atoi(args[1].s)) <= 0) {
+				out_send(fd, "Invalid limit.\r\n", 16);
+				return 1;
+			}
+			store_limit((unsigned long)i * 1024);
+		}
+		store_stats(&ss);
+		snprintf(buf, sizeof(buf)-1,
+			"Store limit %lu KiB, %lu KiB used.\r\n", ss.limit / 1024,
+			ss.bytes / 1024);
+		out_send(fd, buf, strlen(buf));
+		return 0;
+	}
+	if(*args[1].s != '\0') {
+		out_send(fd, "Invalid option.\r\n", 17);
+		return 1;
+	}
+	if(!strncmp(args[0].s, "show", 5)) {
+		snprintf(buf, sizeof(buf)-1,
+			"%-16s %-12s %-12s %-10s %-8s %s\r\n", "Owner", "Bytes",
+			"Peak", "Allocs", "Failed", "Shared");
+		out_send(fd, buf, strlen(buf));
+		for(i = 0; mem_owner(i, &ms) == 0; i++) {
+			snprintf(buf, sizeof(buf)-1,
+				"%-16s %-12lu %-12lu %-10lu %-8lu %s\r\n", ms.name,
+				ms.bytes, ms.peak, ms.allocs, ms.failed,
+				ms.shared ? "yes" : "no");
+			out_send(fd, buf, strlen(buf));
+		}
+		if(mem_getcap() > 0) {
+			snprintf(buf, sizeof(buf)-1, "Session cap: %lu KiB\r\n",
+				mem_getcap() / 1024);
+		}
+		else {
+			snprintf(buf, sizeof(buf)-1, "Session cap: none\r\n");
+		}
+		out_send(fd, buf, strlen(buf));
+	}
+	else if(!strncmp(args[0].s, "sessions", 9)) {
+		snprintf(buf, sizeof(buf)-1, "%-8s %-24s %-12s %-12s %s\r\n",
+			"Session", "Address", "Bytes", "Peak", "Failed");
+		out_send(fd, buf, strlen(buf));
+		while((s = session_next(&pos)) != NULL) {
+			snprintf(buf, sizeof(buf)-1,
+				"%-8u %-24s %-12lu %-12lu %lu%s\r\n", s->id, s->addr,
+				s->mem, s->mem_peak, s->mem_failed,
+				s->fd == fd ? " *" : "");
+			out_send(fd, buf, strlen(buf));
+		}
+	}
+	else if(!strncmp(args[0].s, "commands", 9)) {
+		snprintf(buf, sizeof(buf)-1, "%-16s %-14s %s\r\n", "Command",
+			"Bytes", "Allocs");
+		out_send(fd, buf, strlen(buf));
+		for(i = 0; mem_command(i, &ms) == 0; i++) {
+			snprintf(buf, sizeof(buf)-1, "%-16s %-14lu %lu\r\n",
+				ms.name, ms.bytes, ms.allocs);
+			out_send(fd, buf, strlen(buf));
+		}
+	}
+	else if(isdigit((unsigned char)args[0].s[0])) {
+		i = atoi(args[0].s);
+		mem_setcap((unsigned long)i * 1024);
+		if(i > 0) {
+			snprintf(buf, sizeof(buf)-1, "Session cap %d KiB.\r\n", i);
+		}
+		else {
+			snprintf(buf, sizeof(buf)-1, "Session cap off.\r\n");
+		}
+		out_send(fd, buf, strlen(buf));
+	}
+	else {
+		out_send(fd, "Invalid option.\r\n", 17);
+		return 1;
+	}
+	return 0;
+}
+
+CMD_DEF(batch)
+{
+	char buf[128];
+	int total;
+
+	if(!strncmp(args[0].s, "do", 3)) {
+		return batch_inline(fd, args[1].s, BATCH_STOP);
+	}
+	else if(!strncmp(args[0].s, "all", 4)) {
+		return batch_inline(fd, args[1].s, BATCH_CONTINUE);
+	}
+	else if(!strncmp(args[0].s, "list", 5)) {
+		batch_show(fd);
+		return 0;
+	}
+	else if(!strncmp(args[0].s, "reload", 7)) {
+		if((total = batch_reload()) < 0) {
+			out_send(fd, "Cannot reload scripts.\r\n", 24);
+			return 1;
+		}
+		snprintf(buf, sizeof(buf)-1, "Loaded %d scripts.\r\n", total);
+		out_send(fd, buf, strlen(buf));
+		return 0;
+	}
+	else if(!strncmp(args[1].s, "all", 4)) {
+		return batch_script(fd, args[0].s, BATCH_CONTINUE);
+	}
+	else if(!*args[1].s) {
+		return batch_script(fd, args[0].s, BATCH_STOP);
+	}
+	out_send(fd, "Invalid option.\r\n", 17);
+	return 1;
+}
+
 CMD_DEF(exit)
 {
-	global_done = 1;
+	Session *s = session_get(fd);
+
+	/* Only this session ends, it is closed once the command returns. */
+	if(s != NULL) {
+		s->quit = 1;
+	}
 	return 0;
 }
 
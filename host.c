@@ -0,0 +1,676 @@
+/*
+ * host.c - Source for running plugins in host processes.
+ *
+ * Plugins named in HOST_ENV are not loaded into the server. Each one gets
+ * a netcom-host process instead, which loads it with the usual plugin
+ * manager and talks to the server through two rings in shared memory.
+ * The server registers a proxy plugin with the same commands, so help,
+ * abbreviations, rate limits and deadlines work as before. A host that
+ * crashes or hangs past its deadline is restarted on the spot.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#if defined(__linux)
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "host.h"
+#include "ring.h"
+#include "parse.h"
+#include "plugin.h"
+#include "session.h"
+#include "output.h"
+#include "timer.h"
+#include "log.h"
+#include "store.h"
+
+#if defined(__linux)
+/* Plugin host definition and typedef. */
+struct Host {
+	struct Host *next;
+	char path[2048];
+	pid_t pid;
+	RingShared *shm;
+	int shmfd;
+	int efd_host;
+	int efd_server;
+	int alive;
+	unsigned int seq;
+	Plugin *plugin;
+	short unsigned int type;
+	unsigned int timeout;
+	Command *cmds;
+	unsigned int cmd_cnt;
+	char *strings;
+	unsigned int restarts;
+	unsigned long long window;
+	int disabled;
+};
+typedef struct Host Host;
+
+static Host *hosts;
+static HostStats stats;
+static Timer check;
+
+/* Check if a host has answered.
+ */
+static int host_ready(void *arg)
+{
+	Host *h = (Host *)arg;
+
+	return ring_peek(&h->shm->response) != NULL;
+}
+
+/* Kill a host process and forget it.
+ */
+static void host_down(Host *h)
+{
+	if(h->pid > 0) {
+		kill(h->pid, SIGKILL);
+		waitpid(h->pid, NULL, 0);
+		h->pid = 0;
+	}
+	if(h->alive >= 0) {
+		close(h->alive);
+		h->alive = -1;
+	}
+}
+
+/* Check if a host process is still there.
+ */
+static int host_alive(Host *h)
+{
+	struct pollfd pfd;
+
+	if(h->pid <= 0) {
+		return 0;
+	}
+	pfd.fd = h->alive;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll(&pfd, 1, 0) == 0;
+}
+
+/* Read the command table of a new host from its greeting.
+ */
+static int host_hello(Host *h, RingMsg *msg)
+{
+	const char *p = (const char *)(msg + 1);
+	const char *end = p + msg->len;
+	unsigned int info[3];
+	unsigned int i;
+	char *s, *last;
+
+	if(msg->len < sizeof(info)) {
+		return -1;
+	}
+	memcpy(info, p, sizeof(info));
+	p += sizeof(info);
+
+	/* Restarted hosts keep the table of the first one. */
+	if(h->plugin != NULL) {
+		if(info[2] != h->cmd_cnt) {
+			log_write(PMLOG_WARN, "Plugin %s changed its commands, "
+				"use 'mods reload'.", pm_getname(h->plugin));
+		}
+		return 0;
+	}
+
+	if(info[2] > 0 && (p == end || end[-1] != 0)) {
+		return -1;
+	}
+	h->type = info[0];
+	h->timeout = info[1];
+	h->cmds = (Command *)calloc(info[2] ? info[2] : 1, sizeof(Command));
+	h->strings = (char *)malloc(end - p + 1);
+	if(h->cmds == NULL || h->strings == NULL) {
+		return -1;
+	}
+	memcpy(h->strings, p, end - p);
+	h->strings[end - p] = 0;
+	s = h->strings;
+	last = h->strings + (end - p);
+	for(i = 0; i < info[2]; i++) {
+		Command *cmd = &h->cmds[i];
+
+		if(s + 2 * sizeof(unsigned int) >= last) {
+			return -1;
+		}
+		memcpy(&cmd->timeout, s, sizeof(unsigned int));
+		s += sizeof(unsigned int);
+		memcpy(&cmd->flags, s, sizeof(unsigned int));
+		s += sizeof(unsigned int);
+		cmd->name = s;
+		s += strlen(s) + 1;
+		if(s >= last) {
+			return -1;
+		}
+		cmd->args = s;
+		s += strlen(s) + 1;
+		if(s >= last) {
+			return -1;
+		}
+		cmd->help = s;
+		s += strlen(s) + 1;
+	}
+	h->cmd_cnt = info[2];
+	return 0;
+}
+
+/* Run a store operation for a host and send back the result, returns
+ * -1 if no answer could be sent and the host must be dropped.
+ */
+static int host_store(Host *h, RingMsg *msg)
+{
+	const char *p = (const char *)(msg + 1);
+	unsigned int head[4];
+	const char *key = p + sizeof(head);
+	char *buf;
+	int rc = -1, len = 0;
+
+	memset(head, 0, sizeof(head));
+	if(msg->len < sizeof(head)) {
+		head[0] = -1;
+	}
+	else {
+		memcpy(head, p, sizeof(head));
+		if(head[2] == 0 || head[2] > msg->len - sizeof(head)
+				|| key[head[2] - 1] != 0) {
+			head[0] = -1;
+		}
+	}
+	if(head[3] > STORE_VALUE) {
+		head[3] = STORE_VALUE;
+	}
+
+	/* The host waits for an answer, a failed one still needs room. */
+	buf = (char *)ring_reserve(&h->shm->request, sizeof(int)
+		+ (head[0] == RING_STORE_GET ? head[3] : 0));
+	if(buf == NULL && head[0] == RING_STORE_GET) {
+		head[0] = -1;
+		buf = (char *)ring_reserve(&h->shm->request, sizeof(int));
+	}
+	if(buf == NULL) {
+		log_write(PMLOG_ERROR, "Plugin host for %s cannot get a store "
+			"answer.", h->path);
+		return -1;
+	}
+	switch(head[0]) {
+		case RING_STORE_GET:
+			rc = store_get(key, buf + sizeof(int), head[3]);
+			len = rc < 0 ? 0 : (rc < (int)head[3] ? rc : (int)head[3]);
+		break;
+		case RING_STORE_SET:
+			if(head[3] <= msg->len - sizeof(head) - head[2]) {
+				rc = store_set(key, key + head[2], head[3], head[1]);
+			}
+		break;
+		case RING_STORE_DEL:
+			rc = store_del(key);
+		break;
+	}
+	memcpy(buf, &rc, sizeof(int));
+	ring_commit(&h->shm->request, RING_REPLY, msg->seq, -1,
+		sizeof(int) + len);
+	ring_wake(&h->shm->host_sleeping, h->efd_host);
+	return 0;
+}
+
+/* Start the process of a host and wait for its greeting.
+ */
+static int host_spawn(Host *h)
+{
+	unsigned long long until = timer_clock() + HOST_START;
+	int sv[2];
+	pid_t pid;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, sv) < 0) {
+		return -1;
+	}
+	memset(h->shm, 0, sizeof(RingShared));
+
+	if((pid = fork()) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if(pid == 0) {
+		int src[4] = { h->shmfd, h->efd_host, h->efd_server, sv[1] };
+		int tmp[4];
+		long fd, max = sysconf(_SC_OPEN_MAX);
+		int i;
+
+		/* Hand the host its descriptors as 3 to 6, nothing else. */
+		for(i = 0; i < 4; i++) {
+			tmp[i] = fcntl(src[i], F_DUPFD, 7);
+		}
+		for(i = 0; i < 4; i++) {
+			dup2(tmp[i], 3 + i);
+		}
+		if(max < 0 || max > 65536) {
+			max = 65536;
+		}
+		for(fd = 7; fd < max; fd++) {
+			close(fd);
+		}
+		execl(HOST_BINARY, HOST_BINARY, h->path, (char *)NULL);
+		_exit(127);
+	}
+	close(sv[1]);
+	h->pid = pid;
+	h->alive = sv[0];
+
+	while(1) {
+		unsigned long long now = timer_clock();
+		RingMsg *msg;
+		int rc;
+
+		if(now >= until) {
+			break;
+		}
+		rc = ring_wait(&h->shm->server_sleeping, h->efd_server,
+			h->alive, host_ready, h, (int)(until - now));
+		if(rc < 0) {
+			break;
+		}
+		while(rc >= 0 && (msg = ring_peek(&h->shm->response)) != NULL) {
+			if(msg->type == RING_LOG) {
+				log_write(msg->fd, "%s: %.*s", h->path,
+					(int)msg->len, (const char *)(msg + 1));
+			}
+			else if(msg->type == RING_STORE) {
+				rc = host_store(h, msg);
+			}
+			else if(msg->type == RING_HELLO) {
+				rc = host_hello(h, msg);
+				ring_release(&h->shm->response, msg);
+				return rc;
+			}
+			ring_release(&h->shm->response, msg);
+		}
+		if(rc < 0) {
+			break;
+		}
+	}
+	host_down(h);
+	return -1;
+}
+
+/* Start a host again after it went down.
+ */
+static int host_restart(Host *h)
+{
+	unsigned long long now = timer_clock();
+
+	if(h->disabled) {
+		return -1;
+	}
+	if(now - h->window > HOST_WINDOW) {
+		h->window = now;
+		h->restarts = 0;
+	}
+	if(++h->restarts > HOST_RESTARTS) {
+		log_write(PMLOG_ERROR, "Plugin host for %s keeps failing, "
+			"disabled until 'mods reload'.", h->path);
+		h->disabled = 1;
+		return -1;
+	}
+	stats.restarts++;
+	if(host_spawn(h) < 0) {
+		log_write(PMLOG_ERROR, "Cannot restart plugin host for %s.",
+			h->path);
+		return -1;
+	}
+	log_write(PMLOG_INFO, "Restarted plugin host for %s, pid %d.",
+		h->path, (int)h->pid);
+	return 0;
+}
+
+/* Send a request to a host and relay its output until it is done.
+ */
+static int host_call(Host *h, unsigned int type, const SOCKET fd,
+	const void *payload, unsigned int len)
+{
+	Session *s = session_get(fd);
+	unsigned long long until;
+	void *buf;
+
+	if(!host_alive(h)) {
+		host_down(h);
+		if(host_restart(h) < 0) {
+			out_send(fd, "Plugin unavailable.\r\n", 21);
+			return 1;
+		}
+	}
+	if((buf = ring_reserve(&h->shm->request, len)) == NULL) {
+		out_send(fd, "Plugin unavailable.\r\n", 21);
+		return 1;
+	}
+	memcpy(buf, payload, len);
+	ring_commit(&h->shm->request, type, ++h->seq, (int)fd, len);
+	ring_wake(&h->shm->host_sleeping, h->efd_host);
+	stats.calls++;
+
+	until = (s != NULL && s->deadline ? s->deadline
+		: timer_clock() + CMD_TIMEOUT) + HOST_GRACE;
+	while(1) {
+		unsigned long long now = timer_clock();
+		RingMsg *msg;
+		int rc;
+
+		rc = ring_wait(&h->shm->server_sleeping, h->efd_server,
+			h->alive, host_ready, h, now < until ? (int)(until - now) : 0);
+		if(rc == 0 && timer_clock() < until) {
+			continue;
+		}
+		if(rc <= 0) {
+			log_write(PMLOG_ERROR, "Plugin host for %s %s.", h->path,
+				rc < 0 ? "crashed" : "stopped responding");
+			stats.crashes++;
+			host_down(h);
+			if(rc < 0) {
+				out_send(fd, "Plugin failed.\r\n", 16);
+			}
+			(void)host_restart(h);
+			return 1;
+		}
+
+		while((msg = ring_peek(&h->shm->response)) != NULL) {
+			int done = 0, failed = 0;
+
+			switch(msg->type) {
+				case RING_SEND:
+					out_send(msg->fd, msg + 1, msg->len);
+				break;
+				case RING_LOG:
+					log_write(msg->fd, "%.*s", (int)msg->len,
+						(const char *)(msg + 1));
+				break;
+				case RING_STORE:
+					failed = host_store(h, msg) < 0;
+				break;
+				case RING_DONE:
+					if(msg->seq == h->seq) {
+						memcpy(&rc, msg + 1, sizeof(int));
+						done = 1;
+					}
+				break;
+				default:
+				break;
+			}
+			ring_release(&h->shm->response, msg);
+			ring_wake(&h->shm->host_sleeping, h->efd_host);
+			if(done) {
+				return rc;
+			}
+			if(failed) {
+				stats.crashes++;
+				host_down(h);
+				out_send(fd, "Plugin failed.\r\n", 16);
+				(void)host_restart(h);
+				return 1;
+			}
+		}
+	}
+}
+
+/* Milliseconds left until the deadline of a session.
+ */
+static unsigned int host_remaining(const SOCKET fd)
+{
+	Session *s = session_get(fd);
+	unsigned long long now = timer_clock();
+
+	if(s == NULL || !s->deadline) {
+		return 0;
+	}
+	return s->deadline > now ? (unsigned int)(s->deadline - now) : 1;
+}
+
+/* Proxy for every command of an isolated plugin.
+ */
+static int host_command(const SOCKET fd, const Argument *args)
+{
+	const Command *cmd = parse_current();
+	char buf[SESSION_LINE + 2 * sizeof(unsigned int)];
+	unsigned int head[2];
+	unsigned int len;
+	Host *h;
+	int i;
+
+	for(h = hosts; h != NULL; h = h->next) {
+		if(cmd >= h->cmds && cmd < h->cmds + h->cmd_cnt) {
+			break;
+		}
+	}
+	if(h == NULL) {
+		out_send(fd, "Plugin unavailable.\r\n", 21);
+		return 1;
+	}
+
+	/* Arguments are checked here and parsed again by the host. */
+	head[0] = cmd - h->cmds;
+	head[1] = host_remaining(fd);
+	memcpy(buf, head, sizeof(head));
+	len = sizeof(head);
+	for(i = 0; cmd->args[i]; i++) {
+		unsigned int room = sizeof(buf) - len;
+		int n = 0;
+
+		switch(cmd->args[i]) {
+			case 's':
+				n = snprintf(buf + len, room, "%s ", args[i].s);
+			break;
+			case 'd':
+				n = snprintf(buf + len, room, "%d ", args[i].d);
+			break;
+			case 'f':
+				n = snprintf(buf + len, room, "%.9g ", args[i].f);
+			break;
+			case 'r':
+				n = snprintf(buf + len, room, "%s", args[i].s);
+			break;
+		}
+		if(n < 0 || (unsigned int)n >= room) {
+			out_send(fd, "Bad argument(s).\r\n", 18);
+			return 1;
+		}
+		len += n;
+	}
+	buf[len++] = 0;
+	return host_call(h, RING_CALL, fd, buf, len);
+}
+
+/* Proxy for running an isolated module.
+ */
+static void host_exec(Plugin *self, const SOCKET fd)
+{
+	unsigned int remaining;
+	Host *h;
+
+	/* Initialization happened in the host already. */
+	if(fd == INVALID_SOCKET) {
+		return;
+	}
+	for(h = hosts; h != NULL && h->plugin != self; h = h->next);
+	if(h == NULL) {
+		return;
+	}
+	remaining = host_remaining(fd);
+	(void)host_call(h, RING_EXEC, fd, &remaining, sizeof(remaining));
+}
+
+/* Restart hosts that went down while idle, runs periodically.
+ */
+static void host_check(Timer *t, void *arg)
+{
+	Host *h;
+
+	for(h = hosts; h != NULL; h = h->next) {
+		if(!h->disabled && !host_alive(h)) {
+			log_write(PMLOG_ERROR, "Plugin host for %s exited.", h->path);
+			stats.crashes++;
+			host_down(h);
+			(void)host_restart(h);
+		}
+	}
+}
+
+/* Free a host and everything it owns.
+ */
+static void host_free(Host *h)
+{
+	host_down(h);
+	if(h->shm != NULL && h->shm != MAP_FAILED) {
+		munmap(h->shm, sizeof(RingShared));
+	}
+	if(h->shmfd >= 0) {
+		close(h->shmfd);
+	}
+	if(h->efd_host >= 0) {
+		close(h->efd_host);
+	}
+	if(h->efd_server >= 0) {
+		close(h->efd_server);
+	}
+	free(h->cmds);
+	free(h->strings);
+	free(h);
+}
+
+/* Create a host for a plugin file and start it.
+ */
+static Host *host_new(const char *dirname, const char *name)
+{
+	Host *h;
+
+	h = (Host *)calloc(1, sizeof(Host));
+	if(h == NULL) {
+		return NULL;
+	}
+	h->alive = -1;
+	snprintf(h->path, sizeof(h->path), "%s/%s", dirname, name);
+	h->shmfd = memfd_create("netcom-host", MFD_CLOEXEC);
+	h->efd_host = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+	h->efd_server = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+	if(h->shmfd < 0 || h->efd_host < 0 || h->efd_server < 0
+			|| ftruncate(h->shmfd, sizeof(RingShared)) < 0) {
+		host_free(h);
+		return NULL;
+	}
+	h->shm = (RingShared *)mmap(NULL, sizeof(RingShared),
+		PROT_READ|PROT_WRITE, MAP_SHARED, h->shmfd, 0);
+	if(h->shm == MAP_FAILED || host_spawn(h) < 0) {
+		host_free(h);
+		return NULL;
+	}
+
+	/* Proxy plugin standing in for the real one. */
+	h->plugin = pm_attach(name, h->type, host_exec);
+	if(h->plugin == NULL) {
+		host_free(h);
+		return NULL;
+	}
+	pm_settimeout(h->plugin, h->timeout);
+	if(h->cmd_cnt) {
+		unsigned int i;
+
+		for(i = 0; i < h->cmd_cnt; i++) {
+			h->cmds[i].func = host_command;
+		}
+		pm_set(h->plugin, h->cmds, h->cmd_cnt);
+	}
+	return h;
+}
+#endif
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Start a host process for every isolated plugin of a directory.
+ */
+int host_init(const char *dirname)
+{
+#if defined(__linux)
+	const char *list = getenv(HOST_ENV);
+	struct dirent *p;
+	DIR *dir;
+
+	pm_isolate(list);
+	if(list == NULL || !*list) {
+		return 0;
+	}
+	if((dir = opendir(dirname)) == NULL) {
+		return -1;
+	}
+	while((p = readdir(dir)) != NULL) {
+		Host *h;
+
+		if(!strstr(p->d_name, ".so") || !pm_isolated(p->d_name)) {
+			continue;
+		}
+		if((h = host_new(dirname, p->d_name)) == NULL) {
+			log_write(PMLOG_ERROR, "Cannot start plugin host for %s.",
+				p->d_name);
+			continue;
+		}
+		h->next = hosts;
+		hosts = h;
+		stats.hosts++;
+		log_write(PMLOG_INFO, "Plugin %s runs in host process %d.",
+			p->d_name, (int)h->pid);
+	}
+	closedir(dir);
+	if(hosts != NULL) {
+		timer_init(&check, host_check, NULL);
+		timer_every(&check, HOST_CHECK);
+	}
+#endif
+	return 0;
+}
+
+/* Stop all host processes.
+ */
+void host_deinit(void)
+{
+#if defined(__linux)
+	timer_cancel(&check);
+	while(hosts != NULL) {
+		Host *h = hosts;
+
+		hosts = h->next;
+		host_free(h);
+	}
+	stats.hosts = 0;
+#endif
+}
+
+/* Get host statistics.
+ */
+void host_stats(HostStats *st)
+{
+#if defined(__linux)
+	*st = stats;
+#else
+	memset(st, 0, sizeof(HostStats));
+#endif
+}
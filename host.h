@@ -0,0 +1,45 @@
+/*
+ * host.h - Header for running plugins in host processes.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+/* Environment variable listing plugins to isolate, or '*' for all. */
+#define HOST_ENV "NETCOM_ISOLATE"
+/* Helper process binary. */
+#define HOST_BINARY "./netcom-host"
+/* Longest wait for a new host to load its plugin (ms). */
+#define HOST_START 5000
+/* A host still busy this long past the deadline is killed (ms). */
+#define HOST_GRACE 1000
+/* Hosts that exit while idle are noticed this often (ms). */
+#define HOST_CHECK 1000
+/* Restarts allowed within HOST_WINDOW before a host is disabled. */
+#define HOST_RESTARTS 5
+#define HOST_WINDOW 60000
+
+/* Host statistics definition and typedef. */
+struct HostStats {
+	unsigned int hosts;
+	unsigned long calls;
+	unsigned long crashes;
+	unsigned long restarts;
+};
+typedef struct HostStats HostStats;
+
+/* Start a host process for every isolated plugin of a directory. */
+extern int host_init(const char *dirname);
+
+/* Stop all host processes, call after pm_deinit(). */
+extern void host_deinit(void);
+
+/* Get host statistics. */
+extern void host_stats(HostStats *stats);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * hostproc.c - Source for the plugin host process.
+ *
+ * Started by the server with the shared rings on descriptor 3, its own
+ * eventfd on 4, the eventfd of the server on 5 and a socket that closes
+ * with the server on 6. Loads one plugin, announces its commands and
+ * runs requests until the server goes away.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ring.h"
+#include "parse.h"
+#include "plugin.h"
+#include "store.h"
+
+#define HOST_SHM 3
+#define HOST_EFD 4
+#define HOST_SERVER 5
+#define HOST_ALIVE 6
+#define HOST_LOGLEN 256
+
+static RingShared *shm;
+static unsigned long long deadline;
+static unsigned int seq;
+
+/* Check for a request from the server.
+ */
+static int host_request(void *arg)
+{
+	return ring_peek(&shm->request) != NULL;
+}
+
+/* Check for room in the response ring.
+ */
+static int host_room(void *arg)
+{
+	return ring_reserve(&shm->response, *(unsigned int *)arg) != NULL;
+}
+
+/* Reserve room for a response, waits for the server to make some.
+ */
+static void *host_reserve(unsigned int len)
+{
+	void *buf;
+
+	while((buf = ring_reserve(&shm->response, len)) == NULL) {
+		if(ring_wait(&shm->host_sleeping, HOST_EFD, HOST_ALIVE,
+				host_room, &len, -1) < 0) {
+			exit(0);
+		}
+	}
+	return buf;
+}
+
+/* Publish a response and wake the server.
+ */
+static void host_commit(unsigned int type, int fd, unsigned int len)
+{
+	ring_commit(&shm->response, type, seq, fd, len);
+	ring_wake(&shm->server_sleeping, HOST_SERVER);
+}
+
+/* Send output to a client through the server.
+ */
+static int host_send(const SOCKET fd, const void *buf, int len)
+{
+	const char *p = (const char *)buf;
+	int left = len;
+
+	while(left > 0) {
+		unsigned int n = left > RING_MSGMAX ? RING_MSGMAX : left;
+
+		memcpy(host_reserve(n), p, n);
+		host_commit(RING_SEND, fd, n);
+		p += n;
+		left -= n;
+	}
+	return len;
+}
+
+/* Log through the server.
+ */
+static void host_log(int level, const char *fmt, va_list ap)
+{
+	char *buf = (char *)host_reserve(HOST_LOGLEN);
+	int len;
+
+	len = vsnprintf(buf, HOST_LOGLEN, fmt, ap);
+	if(len < 0) {
+		len = 0;
+	}
+	else if(len >= HOST_LOGLEN) {
+		len = HOST_LOGLEN - 1;
+	}
+	host_commit(RING_LOG, level, len);
+}
+
+/* Set deadline of the running command.
+ */
+static void host_deadline(const SOCKET fd, unsigned int ms)
+{
+	deadline = ms ? ring_now() + ms * 1000000ULL : 0;
+}
+
+/* Check if the running command is past its deadline.
+ */
+static int host_cancelled(const SOCKET fd)
+{
+	return deadline && ring_now() >= deadline;
+}
+
+/* Forward a store operation to the server and wait for the result.
+ */
+static int host_store(unsigned int op, const char *key, const void *val,
+	int len, unsigned int ttl)
+{
+	unsigned int head[4];
+	unsigned int klen = strlen(key) + 1;
+	char *buf;
+	int rc = -1;
+
+	if(op == RING_STORE_GET && len > STORE_VALUE) {
+		len = STORE_VALUE;
+	}
+	if(len < 0 || klen > STORE_KEY + 1 || len > STORE_VALUE) {
+		return -1;
+	}
+	head[0] = op;
+	head[1] = ttl;
+	head[2] = klen;
+	head[3] = len;
+	buf = (char *)host_reserve(sizeof(head) + klen
+		+ (op == RING_STORE_SET ? len : 0));
+	memcpy(buf, head, sizeof(head));
+	memcpy(buf + sizeof(head), key, klen);
+	if(op == RING_STORE_SET && len > 0) {
+		memcpy(buf + sizeof(head) + klen, val, len);
+	}
+	host_commit(RING_STORE, -1, sizeof(head) + klen
+		+ (op == RING_STORE_SET ? len : 0));
+
+	while(1) {
+		RingMsg *msg;
+
+		if(ring_wait(&shm->host_sleeping, HOST_EFD, HOST_ALIVE,
+				host_request, NULL, -1) < 0) {
+			exit(0);
+		}
+		if((msg = ring_peek(&shm->request)) == NULL) {
+			continue;
+		}
+		if(msg->type == RING_REPLY && msg->len >= sizeof(int)) {
+			memcpy(&rc, msg + 1, sizeof(int));
+			if(op == RING_STORE_GET && val != NULL) {
+				memcpy((void *)val, (const char *)(msg + 1) + sizeof(int),
+					msg->len - sizeof(int));
+			}
+		}
+		ring_release(&shm->request, msg);
+		return rc;
+	}
+}
+
+/* Get a value from the store of the server.
+ */
+static int host_store_get(const char *key, void *buf, int len)
+{
+	return host_store(RING_STORE_GET, key, buf, buf != NULL ? len : 0, 0);
+}
+
+/* Set a value in the store of the server.
+ */
+static int host_store_set(const char *key, const void *val, int len,
+	unsigned int ttl)
+{
+	return host_store(RING_STORE_SET, key, val, len, ttl);
+}
+
+/* Delete a value from the store of the server.
+ */
+static int host_store_del(const char *key)
+{
+	return host_store(RING_STORE_DEL, key, NULL, 0, 0);
+}
+
+/* Services of the host, tracing and limits stay with the server. */
+static const PluginAPI host_api = {
+	host_send,
+	NULL,
+	NULL,
+	host_log,
+	host_deadline,
+	host_cancelled,
+	NULL,
+	host_store_get,
+	host_store_set,
+	host_store_del,
+	NULL,
+	NULL
+};
+
+/* Announce the plugin and its commands.
+ */
+static void host_hello(Plugin *plugin)
+{
+	unsigned int info[3], i, len;
+	Command *cmds;
+	char *buf, *p;
+
+	info[0] = pm_gettype(plugin);
+	info[1] = pm_gettimeout(plugin);
+	info[2] = pm_getcommands(plugin, &cmds);
+	len = sizeof(info);
+	for(i = 0; i < info[2]; i++) {
+		len += 2 * sizeof(unsigned int) + strlen(cmds[i].name)
+			+ strlen(cmds[i].args) + strlen(cmds[i].help) + 3;
+	}
+	if(len > RING_MSGMAX) {
+		fprintf(stderr, "Error: Too many commands in plugin.\n");
+		exit(1);
+	}
+
+	buf = p = (char *)host_reserve(len);
+	memcpy(p, info, sizeof(info));
+	p += sizeof(info);
+	for(i = 0; i < info[2]; i++) {
+		memcpy(p, &cmds[i].timeout, sizeof(unsigned int));
+		p += sizeof(unsigned int);
+		memcpy(p, &cmds[i].flags, sizeof(unsigned int));
+		p += sizeof(unsigned int);
+		p = stpcpy(p, cmds[i].name) + 1;
+		p = stpcpy(p, cmds[i].args) + 1;
+		p = stpcpy(p, cmds[i].help) + 1;
+	}
+	host_commit(RING_HELLO, -1, p - buf);
+}
+
+/* Run a command of the plugin.
+ */
+static int host_call(Plugin *plugin, const SOCKET fd, const char *data,
+	unsigned int len)
+{
+	char line[RING_MSGMAX];
+	unsigned int head[2];
+	Argument *args = NULL;
+	Command *cmds;
+	unsigned int cnt;
+	int rc;
+
+	cnt = pm_getcommands(plugin, &cmds);
+	if(len <= sizeof(head)) {
+		return 1;
+	}
+	memcpy(head, data, sizeof(head));
+	if(head[0] >= cnt) {
+		return 1;
+	}
+
+	/* Server checked the arguments, tokenize them like it did. */
+	snprintf(line, sizeof(line), "%s %.*s", cmds[head[0]].name,
+		(int)(len - sizeof(head)), data + sizeof(head));
+	strtok(line, DELIM);
+	if(strlen(cmds[head[0]].args)) {
+		if((args = arg_parser(cmds[head[0]].args)) == NULL) {
+			return 1;
+		}
+	}
+
+	host_deadline(fd, head[1]);
+	rc = cmds[head[0]].func(fd, args);
+	host_deadline(fd, 0);
+	pm_free(args);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	Plugin *plugin;
+
+	if(argc != 2) {
+		fprintf(stderr, "Usage: %s plugin.so\n", argv[0]);
+		return 1;
+	}
+
+	shm = (RingShared *)mmap(NULL, sizeof(RingShared),
+		PROT_READ|PROT_WRITE, MAP_SHARED, HOST_SHM, 0);
+	if(shm == MAP_FAILED) {
+		fprintf(stderr, "Error: Cannot map shared rings.\n");
+		return 1;
+	}
+
+	pm_setapi(&host_api);
+	if((plugin = pm_open(argv[1])) == NULL) {
+		pm_log(PMLOG_ERROR, "Cannot load plugin %s.", argv[1]);
+		return 1;
+	}
+	pm_register(INVALID_SOCKET);
+	host_hello(plugin);
+
+	while(ring_wait(&shm->host_sleeping, HOST_EFD, HOST_ALIVE,
+			host_request, NULL, -1) >= 0) {
+		RingMsg *msg;
+
+		while((msg = ring_peek(&shm->request)) != NULL) {
+			RingMsg req = *msg;
+			char data[RING_MSGMAX];
+			int rc = 0;
+
+			memcpy(data, msg + 1, req.len);
+			ring_release(&shm->request, msg);
+			seq = req.seq;
+
+			if(req.type == RING_CALL) {
+				rc = host_call(plugin, req.fd, data, req.len);
+			}
+			else if(req.type == RING_EXEC) {
+				unsigned int ms = 0;
+
+				memcpy(&ms, data, req.len < sizeof(ms) ? req.len
+					: sizeof(ms));
+				host_deadline(req.fd, ms);
+				pm_exec(plugin, req.fd);
+				host_deadline(req.fd, 0);
+			}
+			memcpy(host_reserve(sizeof(rc)), &rc, sizeof(rc));
+			host_commit(RING_DONE, req.fd, sizeof(rc));
+		}
+	}
+	pm_deinit();
+	return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * limit.c - Source for client rate limiting and admission control.
+ *
+ * Every client address owns a token bucket for new connections and one
+ * bucket per command rule, shared by all sessions from that address.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "limit.h"
+#include "session.h"
+#include "timer.h"
+#include "mem.h"
+
+#define LIMIT_BUCKETS 256
+
+/* Token bucket definition and typedef. */
+struct Bucket {
+	double tokens;
+	unsigned long long last;
+};
+typedef struct Bucket Bucket;
+
+/* Command rule definition and typedef. */
+struct LimitRule {
+	char name[LIMIT_NAME];
+	double rate;
+	double burst;
+};
+typedef struct LimitRule LimitRule;
+
+/* Limit entry definition and typedef. */
+struct LimitEntry {
+	struct LimitEntry *next;
+	char addr[INET6_ADDRSTRLEN+1];
+	int sessions;
+	unsigned long long used;
+	Bucket conn;
+	Bucket cmds[LIMIT_RULES+1];
+};
+typedef struct LimitEntry LimitEntry;
+
+/* Cheap commands get more room, expensive ones less. */
+static LimitRule rules[LIMIT_RULES] = {
+	{ "help", 20.0, 40.0 },
+	{ "when", 20.0, 40.0 },
+	{ "cdir", 20.0, 40.0 },
+	{ "list", 1.0, 3.0 },
+	{ "run", 1.0, 3.0 }
+};
+static int rule_count = 5;
+
+static LimitEntry *buckets[LIMIT_BUCKETS];
+static LimitStats stats;
+
+/* Hash an address string.
+ */
+static unsigned int limit_hash(const char *addr)
+{
+	unsigned int h = 2166136261U;
+
+	while(*addr) {
+		h = (h ^ (unsigned char)*addr++) * 16777619U;
+	}
+	return h % LIMIT_BUCKETS;
+}
+
+/* Take a token from a bucket, returns non zero if empty.
+ */
+static int limit_take(Bucket *b, double rate, double burst,
+	unsigned long long now)
+{
+	if(b->last == 0) {
+		b->tokens = burst;
+	}
+	else {
+		b->tokens += (now - b->last) * rate / 1000.0;
+		if(b->tokens > burst) {
+			b->tokens = burst;
+		}
+	}
+	b->last = now;
+	if(b->tokens < 1.0) {
+		return 1;
+	}
+	b->tokens -= 1.0;
+	return 0;
+}
+
+/* Find rule index of a command, rule_count is the default.
+ */
+static int limit_find(const char *name)
+{
+	int i;
+
+	for(i = 0; i < rule_count; i++) {
+		if(!strcmp(rules[i].name, name)) {
+			return i;
+		}
+	}
+	return rule_count;
+}
+
+/* Find or create the entry of an address.
+ */
+static LimitEntry *limit_entry(const char *addr, unsigned long long now)
+{
+	unsigned int h = limit_hash(addr);
+	LimitEntry *e;
+
+	for(e = buckets[h]; e != NULL; e = e->next) {
+		if(!strcmp(e->addr, addr)) {
+			break;
+		}
+	}
+	if(e == NULL) {
+		e = (LimitEntry *)calloc(1, sizeof(LimitEntry));
+		if(e == NULL) {
+			return NULL;
+		}
+		snprintf(e->addr, sizeof(e->addr), "%s", addr);
+		e->next = buckets[h];
+		buckets[h] = e;
+	}
+	e->used = now;
+	return e;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Admit a new connection.
+ */
+LimitEntry *limit_connect(const char *addr, int sessions)
+{
+	unsigned long long now = timer_clock();
+	LimitEntry *e;
+
+	if(sessions >= LIMIT_SESSIONS) {
+		stats.rejected_sessions++;
+		return NULL;
+	}
+	if((e = limit_entry(addr, now)) == NULL) {
+		stats.rejected_sessions++;
+		return NULL;
+	}
+
+	if(limit_take(&e->conn, LIMIT_CONN_RATE, LIMIT_CONN_BURST, now)) {
+		stats.rejected_connects++;
+		return NULL;
+	}
+	e->sessions++;
+	stats.accepted++;
+	return e;
+}
+
+/* Account a session taken over from another process, never rejects.
+ */
+LimitEntry *limit_attach(const char *addr)
+{
+	LimitEntry *e = limit_entry(addr, timer_clock());
+
+	if(e != NULL) {
+		e->sessions++;
+	}
+	return e;
+}
+
+/* Release the entry of a closed connection.
+ */
+void limit_disconnect(LimitEntry *entry)
+{
+	if(entry != NULL && entry->sessions > 0) {
+		entry->sessions--;
+		entry->used = timer_clock();
+	}
+}
+
+/* Admit a command of a client.
+ */
+int limit_command(const SOCKET fd, const char *name)
+{
+	unsigned long long now = timer_clock();
+	Session *s = session_get(fd);
+	LimitEntry *e;
+	double rate, burst;
+	int i;
+
+	if(s == NULL) {
+		return 0;
+	}
+	if(mem_exceeded(s)) {
+		stats.rejected_memory++;
+		return 1;
+	}
+	if((e = s->limit) == NULL) {
+		return 0;
+	}
+
+	i = limit_find(name);
+	if(i < rule_count) {
+		rate = rules[i].rate;
+		burst = rules[i].burst;
+	}
+	else {
+		rate = LIMIT_CMD_RATE;
+		burst = LIMIT_CMD_BURST;
+	}
+	e->used = now;
+	if(limit_take(&e->cmds[i], rate, burst, now)) {
+		stats.rejected_commands++;
+		return 1;
+	}
+	stats.commands++;
+	return 0;
+}
+
+/* Set rate and burst of a command.
+ */
+int limit_rule(const char *name, double rate, double burst)
+{
+	unsigned int h;
+	int i;
+
+	/* A cut name would never match its command. */
+	if(rate <= 0.0 || burst < 1.0 || strlen(name) >= LIMIT_NAME) {
+		return -1;
+	}
+	i = limit_find(name);
+	if(i == rule_count) {
+		if(rule_count >= LIMIT_RULES) {
+			return -1;
+		}
+		rule_count++;
+
+		/* New rule takes over the default bucket slot, reset it. */
+		for(h = 0; h < LIMIT_BUCKETS; h++) {
+			LimitEntry *e;
+			for(e = buckets[h]; e != NULL; e = e->next) {
+				memset(&e->cmds[i], 0, sizeof(Bucket) * 2);
+			}
+		}
+	}
+	snprintf(rules[i].name, sizeof(rules[i].name), "%s", name);
+	rules[i].rate = rate;
+	rules[i].burst = burst;
+	return 0;
+}
+
+/* Forget addresses that have been unused for a while.
+ */
+void limit_expire(void)
+{
+	unsigned long long now = timer_clock();
+	unsigned int h;
+
+	for(h = 0; h < LIMIT_BUCKETS; h++) {
+		LimitEntry **p = &buckets[h];
+
+		while(*p != NULL) {
+			LimitEntry *e = *p;
+			if(!e->sessions && now - e->used > LIMIT_EXPIRE) {
+				*p = e->next;
+				free(e);
+			}
+			else {
+				p = &e->next;
+			}
+		}
+	}
+}
+
+/* Get admission counters.
+ */
+void limit_stats(LimitStats *st)
+{
+	if(st != NULL) {
+		*st = stats;
+	}
+}
@@ -0,0 +1,68 @@
+/*
+ * limit.h - Header for client rate limiting and admission control.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _LIMIT_H_
+#define _LIMIT_H_
+
+#include "prs/network.h"
+
+/* Most sessions served at once, more are told the server is busy. */
+#define LIMIT_SESSIONS 256
+/* Connections waiting in the kernel accept queue. */
+#define LIMIT_BACKLOG 64
+/* New connections per second allowed from one address. */
+#define LIMIT_CONN_RATE 2.0
+#define LIMIT_CONN_BURST 5.0
+/* Commands per second for commands without a rule. */
+#define LIMIT_CMD_RATE 5.0
+#define LIMIT_CMD_BURST 10.0
+/* Most per command rules. */
+#define LIMIT_RULES 16
+/* Longest command name a rule can hold. */
+#define LIMIT_NAME 32
+/* Addresses without sessions are forgotten after this long (ms). */
+#define LIMIT_EXPIRE 60000
+
+/* Admission counters definition and typedef. */
+struct LimitStats {
+	unsigned long accepted;
+	unsigned long rejected_sessions;
+	unsigned long rejected_connects;
+	unsigned long rejected_commands;
+	unsigned long rejected_memory;
+	unsigned long commands;
+};
+typedef struct LimitStats LimitStats;
+
+/* Limit entry forward declaration. */
+struct LimitEntry;
+
+/* Admit a new connection, returns the entry of its address or NULL. */
+extern struct LimitEntry *limit_connect(const char *addr, int sessions);
+
+/* Account a session taken over from another process. */
+extern struct LimitEntry *limit_attach(const char *addr);
+
+/* Release the entry of a closed connection. */
+extern void limit_disconnect(struct LimitEntry *entry);
+
+/* Admit a command of a client, returns non zero if rejected. */
+extern int limit_command(const SOCKET fd, const char *name);
+
+/* Set rate and burst of a command, returns -1 if table is full or the
+ * name is too long. */
+extern int limit_rule(const char *name, double rate, double burst);
+
+/* Forget addresses that have been unused for a while. */
+extern void limit_expire(void);
+
+/* Get admission counters. */
+extern void limit_stats(LimitStats *stats);
+
+#endif
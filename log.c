@@ -0,0 +1,387 @@
+/*
+ * log.c - Source for the asynchronous logger.
+ *
+ * Each thread formats messages into its own single producer queue, a
+ * background writer drains all queues to stdout. A full queue drops the
+ * message instead of waiting, so a blocked stdout never stalls serving.
+ * Each queue also keeps the rate limits of its thread; the writer reports
+ * what they suppressed once a second, even if the call site went quiet.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "log.h"
+
+#define LOG_MASK (LOG_QUEUE-1)
+#define RATE_SLOTS 64
+#define RATE_WHAT 64
+
+/* Log message definition and typedef. */
+struct LogMsg {
+	int level;
+	time_t when;
+	char text[LOG_MSGLEN];
+};
+typedef struct LogMsg LogMsg;
+
+/* Rate limit slot definition and typedef. */
+struct LogRate {
+	const char *fmt;
+	time_t window;
+	unsigned int count;
+	unsigned int suppressed;
+	int level;
+	char what[RATE_WHAT];
+};
+typedef struct LogRate LogRate;
+
+/* Log queue definition and typedef, lock guards the rates. */
+struct LogQueue {
+	atomic_uint head;
+	atomic_uint tail;
+	LogMsg msg[LOG_QUEUE];
+	pthread_mutex_t lock;
+	LogRate rates[RATE_SLOTS];
+};
+typedef struct LogQueue LogQueue;
+
+static const char *level_names[PMLOG_COUNT] = {
+	"debug", "info", "warn", "error"
+};
+
+static LogQueue *queues[LOG_THREADS];
+static atomic_uint queue_count;
+static _Thread_local LogQueue *queue;
+
+static atomic_int min_level = PMLOG_INFO;
+static atomic_int running;
+static atomic_int stopping;
+static pthread_t writer;
+
+static atomic_ulong written;
+static atomic_ulong dropped;
+static atomic_ulong suppressed;
+
+/* Get queue of calling thread, registering it on first use.
+ */
+static LogQueue *log_queue(void)
+{
+	unsigned int i;
+
+	if(queue != NULL) {
+		return queue;
+	}
+	i = atomic_fetch_add(&queue_count, 1);
+	if(i >= LOG_THREADS) {
+		atomic_fetch_sub(&queue_count, 1);
+		return NULL;
+	}
+	queue = (LogQueue *)calloc(1, sizeof(LogQueue));
+	if(queue != NULL) {
+		pthread_mutex_init(&queue->lock, NULL);
+	}
+	queues[i] = queue;
+	return queue;
+}
+
+/* Write a single message to stdout.
+ */
+static void log_print(const LogMsg *msg)
+{
+	char stamp[32];
+	struct tm tm;
+
+#if defined(_WIN32) || defined(_WIN64)
+	localtime_s(&tm, &msg->when);
+#else
+	localtime_r(&msg->when, &tm);
+#endif
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+	fprintf(stdout, "%s [%-5s] %s\n", stamp, level_names[msg->level],
+		msg->text);
+	atomic_fetch_add(&written, 1);
+}
+
+/* Drain every queue, returns number of messages written.
+ */
+static int log_drain(void)
+{
+	unsigned int count = atomic_load(&queue_count);
+	unsigned int i;
+	int total = 0;
+
+	for(i = 0; i < count && i < LOG_THREADS; i++) {
+		LogQueue *q = queues[i];
+		unsigned int head, tail;
+
+		if(q == NULL) {
+			continue;
+		}
+		tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+		head = atomic_load_explicit(&q->head, memory_order_acquire);
+		while(tail != head) {
+			log_print(&q->msg[tail & LOG_MASK]);
+			++tail;
+			++total;
+		}
+		atomic_store_explicit(&q->tail, tail, memory_order_release);
+	}
+	if(total > 0) {
+		fflush(stdout);
+	}
+	return total;
+}
+
+/* Format how many messages of a call site were suppressed, returns
+ * zero if there were none.
+ */
+static int log_summary(LogRate *r, LogMsg *msg)
+{
+	if(r->suppressed == 0) {
+		return 0;
+	}
+	msg->level = r->level;
+	snprintf(msg->text, sizeof(msg->text),
+		"Suppressed %u more messages like '%s'.", r->suppressed, r->what);
+	r->suppressed = 0;
+	return 1;
+}
+
+/* Report call sites whose window ended before now, or all of them.
+ */
+static void log_sweep(time_t now, int all)
+{
+	unsigned int count = atomic_load(&queue_count);
+	unsigned int i, j;
+	LogMsg msg;
+
+	msg.when = now;
+	for(i = 0; i < count && i < LOG_THREADS; i++) {
+		LogQueue *q = queues[i];
+
+		if(q == NULL) {
+			continue;
+		}
+		pthread_mutex_lock(&q->lock);
+		for(j = 0; j < RATE_SLOTS; j++) {
+			if((all || q->rates[j].window != now)
+					&& log_summary(&q->rates[j], &msg)) {
+				log_print(&msg);
+			}
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	fflush(stdout);
+}
+
+/* Background writer thread.
+ */
+static void *log_thread(void *arg)
+{
+	struct timespec ts = { 0, LOG_INTERVAL * 1000000L };
+	time_t swept = time(NULL);
+
+	while(!atomic_load(&stopping)) {
+		time_t now = time(NULL);
+
+		if(now != swept) {
+			swept = now;
+			log_drain();
+			log_sweep(now, 0);
+		}
+		if(!log_drain()) {
+			nanosleep(&ts, NULL);
+		}
+	}
+	log_drain();
+	log_sweep(time(NULL), 1);
+	return NULL;
+}
+
+/* Put a message on the queue of the calling thread.
+ */
+static void log_push(int level, time_t now, const char *fmt, va_list ap)
+{
+	LogQueue *q = log_queue();
+	unsigned int head;
+	LogMsg *msg;
+
+	if(q == NULL || !atomic_load(&running)) {
+		LogMsg tmp;
+
+		tmp.level = level;
+		tmp.when = now;
+		vsnprintf(tmp.text, sizeof(tmp.text), fmt, ap);
+		log_print(&tmp);
+		fflush(stdout);
+		return;
+	}
+
+	head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	if(head - atomic_load_explicit(&q->tail, memory_order_acquire)
+			>= LOG_QUEUE) {
+		atomic_fetch_add(&dropped, 1);
+		return;
+	}
+	msg = &q->msg[head & LOG_MASK];
+	msg->level = level;
+	msg->when = now;
+	vsnprintf(msg->text, sizeof(msg->text), fmt, ap);
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+/* Queue a formatted message.
+ */
+static void log_pushf(int level, time_t now, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_push(level, now, fmt, ap);
+	va_end(ap);
+}
+
+/* Check rate limit of a call site, returns non zero to drop message.
+ */
+static int log_limited(LogQueue *q, int level, const char *fmt, time_t now)
+{
+	LogRate *r = &q->rates[((unsigned long)fmt >> 4) % RATE_SLOTS];
+	int rc = 0;
+	LogMsg msg;
+
+	pthread_mutex_lock(&q->lock);
+	if(r->fmt != fmt || r->window != now) {
+		/* The slot is taken over, report what the last owner lost. */
+		if(log_summary(r, &msg)) {
+			log_pushf(msg.level, now, "%s", msg.text);
+		}
+		r->fmt = fmt;
+		r->window = now;
+		r->count = 0;
+	}
+	if(++r->count > LOG_BURST) {
+		/* Copy the format, it may belong to a plugin unloaded later. */
+		if(r->suppressed++ == 0) {
+			r->level = level;
+			snprintf(r->what, sizeof(r->what), "%s", fmt);
+		}
+		atomic_fetch_add(&suppressed, 1);
+		rc = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return rc;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Start background writer.
+ */
+int log_init(int level)
+{
+	log_setlevel(level);
+	if(atomic_load(&running)) {
+		return 0;
+	}
+	atomic_store(&stopping, 0);
+	if(pthread_create(&writer, NULL, log_thread, NULL) != 0) {
+		return -1;
+	}
+	atomic_store(&running, 1);
+	return 0;
+}
+
+/* Drain queues and stop background writer.
+ */
+void log_deinit(void)
+{
+	if(!atomic_load(&running)) {
+		return;
+	}
+	atomic_store(&stopping, 1);
+	pthread_join(writer, NULL);
+	atomic_store(&running, 0);
+}
+
+/* Set lowest level that gets logged.
+ */
+void log_setlevel(int level)
+{
+	if(level >= PMLOG_DEBUG && level < PMLOG_COUNT) {
+		atomic_store(&min_level, level);
+	}
+}
+
+/* Get lowest level that gets logged.
+ */
+int log_getlevel(void)
+{
+	return atomic_load(&min_level);
+}
+
+/* Get level by name.
+ */
+int log_level(const char *name)
+{
+	int i;
+
+	for(i = 0; i < PMLOG_COUNT; i++) {
+		if(!strcmp(name, level_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Queue a message for the background writer.
+ */
+void log_vwrite(int level, const char *fmt, va_list ap)
+{
+	LogQueue *q;
+	time_t now;
+
+	if(level < atomic_load_explicit(&min_level, memory_order_relaxed)
+			|| level >= PMLOG_COUNT || fmt == NULL) {
+		return;
+	}
+	now = time(NULL);
+	if((q = log_queue()) != NULL && log_limited(q, level, fmt, now)) {
+		return;
+	}
+	log_push(level, now, fmt, ap);
+}
+
+/* Queue a message for the background writer.
+ */
+void log_write(int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_vwrite(level, fmt, ap);
+	va_end(ap);
+}
+
+/* Get logger statistics.
+ */
+void log_stats(LogStats *stats)
+{
+	if(stats != NULL) {
+		stats->written = atomic_load(&written);
+		stats->dropped = atomic_load(&dropped);
+		stats->suppressed = atomic_load(&suppressed);
+	}
+}
@@ -0,0 +1,59 @@
+/*
+ * log.h - Header for the asynchronous logger.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdarg.h>
+#include "plugin.h"
+
+/* Messages queued per thread, must be a power of two. */
+#define LOG_QUEUE 1024
+/* Longest message kept, longer ones are cut. */
+#define LOG_MSGLEN 256
+/* Most threads that can log. */
+#define LOG_THREADS 64
+/* Writer wakes up this often to drain the queues (ms). */
+#define LOG_INTERVAL 10
+/* Same message allowed this many times per second. */
+#define LOG_BURST 5
+
+/* Logger statistics definition and typedef. */
+struct LogStats {
+	unsigned long written;
+	unsigned long dropped;
+	unsigned long suppressed;
+};
+typedef struct LogStats LogStats;
+
+/* Start background writer, messages below level are ignored. */
+extern int log_init(int level);
+
+/* Drain queues and stop background writer. */
+extern void log_deinit(void);
+
+/* Set lowest level that gets logged. */
+extern void log_setlevel(int level);
+
+/* Get lowest level that gets logged. */
+extern int log_getlevel(void);
+
+/* Get level by name, returns -1 if unknown. */
+extern int log_level(const char *name);
+
+/* Queue a message for the background writer. */
+extern void log_write(int level, const char *fmt, ...);
+
+/* Queue a message for the background writer. */
+extern void log_vwrite(int level, const char *fmt, va_list ap);
+
+/* Get logger statistics. */
+extern void log_stats(LogStats *stats);
+
+#endif
@@ -7,12 +7,60 @@
  ****************************************************************************
  */
 
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
 #include "parse.h"
 #include "plugin.h"
+#include "session.h"
+#include "output.h"
+#include "trace.h"
+#include "log.h"
+#include "timer.h"
+#include "limit.h"
+#include "capture.h"
+#include "upgrade.h"
+#include "host.h"
+#include "store.h"
+#include "channel.h"
+#include "mem.h"
+#include "batch.h"
 
 int plugins_loaded;
-int global_done;
+volatile sig_atomic_t global_done;
+
+/* Services the server exports to plugins. */
+static const PluginAPI server_api = {
+	out_send,
+	trace_begin,
+	trace_end,
+	log_vwrite,
+	session_deadline,
+	session_cancelled,
+	limit_command,
+	store_get,
+	store_set,
+	store_del,
+	mem_realloc,
+	mem_free
+};
+
+/* Housekeeping jobs run this often (ms). */
+#define JOBS_PERIOD 60000
+
+static struct pollfd fds[SESSION_MAX+1];
 
 /* Initialize winsock for windows.
  */
@@ -27,67 +75,341 @@ int ws_init(void)
 #endif
 }
 
-int main()
+/* Close a client session.
+ */
+static void serve_close(const SOCKET fd)
+{
+	Session *sess = session_get(fd);
+
+	/* A channel has no socket of its own. */
+	if(sess != NULL && sess->chan != NULL) {
+		channel_close(sess);
+		return;
+	}
+	if(sess != NULL) {
+		log_write(PMLOG_INFO, "Client %s disconnected.", sess->addr);
+		channel_close(sess);
+		capture_close(sess);
+		limit_disconnect(sess->limit);
+		session_close(fd);
+	}
+	socket_close(fd);
+}
+
+/* Close a session that has been idle for too long.
+ */
+static void serve_idle(Timer *t, void *arg)
+{
+	Session *sess = (Session *)arg;
+
+	if(sess->mux == NULL) {
+		out_send(sess->fd, "Idle timeout.\r\n", 15);
+		out_end(sess->fd);
+	}
+	serve_close(sess->fd);
+}
+
+/* Housekeeping jobs, runs periodically.
+ */
+static void serve_jobs(Timer *t, void *arg)
+{
+	log_write(PMLOG_DEBUG, "Sessions open: %d.", session_count());
+	limit_expire();
+	store_expire();
+}
+
+/* Accept a new client and start its session.
+ */
+static void serve_accept(SOCKET s)
 {
-	unsigned short port = 0xBEEF; /* 48640 */
 	char addr[INET6_ADDRSTRLEN+1];
-	char buf[256];
-	SOCKET s, c;
+	struct LimitEntry *entry;
+	Session *sess;
+	SOCKET c;
+
+	c = server_socket_accept(s);
+	if(c == INVALID_SOCKET) {
+		log_write(PMLOG_WARN, "Client connection not accepted.");
+		return;
+	}
+
+	get_addr(c, addr, sizeof(addr)-1);
+	entry = limit_connect(addr, session_count() - channel_count());
+	sess = entry != NULL ? session_open(c, addr) : NULL;
+	if(sess == NULL) {
+		log_write(PMLOG_WARN, "Server busy, %s rejected.", addr);
+		limit_disconnect(entry);
+		send(c, "Server busy, try again later.\r\n", 31, 0);
+		socket_close(c);
+		return;
+	}
+	sess->limit = entry;
+	session_nonblock(c);
+	capture_open(sess);
+	log_write(PMLOG_INFO, "Client %s connected.", addr);
+	timer_init(&sess->idle, serve_idle, sess);
+	timer_add(&sess->idle, SESSION_IDLE);
+	out_send(c, ">> ", 4);
+	out_end(c);
+}
+
+/* Run a single command line of a client.
+ */
+static void serve_line(Session *sess, char *line, unsigned int len,
+	unsigned long long span)
+{
+	const SOCKET fd = sess->fd;
+	unsigned long long req, start = 0;
+	Session *charged;
+
+	if(capture_active()) {
+		capture_command(sess, line, len);
+		start = trace_now();
+		sess->sent = 0;
+	}
+	trace_request(fd);
+	if((req = trace_begin(fd)) != 0) {
+		trace_end(fd, "recv", span);
+	}
+	charged = mem_charge(sess);
+	(void)parse_input(fd, line);
+	if(!global_done && !sess->quit) out_send(fd, ">> ", 4);
+	out_end(fd);
+	mem_charge(charged);
+	trace_end(fd, "request", req);
+
+	/* Session is gone if the command closed it. */
+	if(start && session_get(fd) == sess) {
+		capture_response(sess, sess->sent,
+			(unsigned long)((trace_now() - start) / 1000));
+	}
+}
+
+/* Read from a client and run every complete line, returns -1 on close.
+ */
+static int serve_input(Session *sess)
+{
+	unsigned long long span = trace_now();
+	const SOCKET fd = sess->fd;
+	char line[SESSION_LINE];
 	int nbytes;
 
+	if(sess->mux != NULL) {
+		return channel_input(sess);
+	}
+	nbytes = recv(fd, sess->line + sess->used,
+		SESSION_LINE - 1 - sess->used, 0);
+	if(nbytes < 0 && session_blocked()) {
+		return 0;
+	}
+	if(nbytes <= 0) {
+		return -1;
+	}
+	sess->used += nbytes;
+	timer_add(&sess->idle, SESSION_IDLE);
+
+	while(!global_done && !sess->quit && sess->used > 0) {
+		char *eol = memchr(sess->line, '\n', sess->used);
+		unsigned int len;
+
+		if(eol != NULL) {
+			len = eol - sess->line + 1;
+		}
+		else if(sess->used == SESSION_LINE - 1) {
+			len = sess->used;
+		}
+		else {
+			break;
+		}
+
+		memcpy(line, sess->line, len);
+		line[len] = 0;
+		sess->used -= len;
+		memmove(sess->line, sess->line + len, sess->used);
+		serve_line(sess, line, len, span);
+	}
+
+	if(sess->quit) {
+		return -1;
+	}
+
+	/* Rest of the input is frames once 'channel on' ran. */
+	return sess->mux != NULL ? channel_run(sess) : 0;
+}
+
+/* Stop serving after the current request, cleaning up on the way out.
+ */
+static void serve_stop(int sig)
+{
+	(void)sig;
+	global_done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned short port = 0xBEEF; /* 48879 */
+	int accepting = 1;
+	Timer jobs;
+	SOCKET s;
+
+	(void)argc;
+#if !defined(_WIN32) && !defined(_WIN64)
+	/* A client gone while its output is sent must not end the server. */
+	signal(SIGPIPE, SIG_IGN);
+#endif
+	signal(SIGINT, serve_stop);
+	signal(SIGTERM, serve_stop);
+	upgrade_init(argv);
+	if(log_init(PMLOG_INFO) == 0) {
+		atexit(log_deinit);
+	}
+	pm_setapi(&server_api);
+	host_init("plugin-sdk");
 	if(pm_init("plugin-sdk") != 0) {
+		host_deinit();
 		return 1;
 	}
 	command_init();
+	pm_register(INVALID_SOCKET);
 	plugins_loaded = 1;
+	channel_init(serve_line);
+	batch_init("scripts");
 
 	if(ws_init() != 0) {
-		fprintf(stderr, "Error: Failed to initialize winsock.\n");
+		log_write(PMLOG_ERROR, "Failed to initialize winsock.");
 		pm_deinit();
+		host_deinit();
 		return 1;
 	}
 
-	s = server_socket_open(&port);
+	s = upgrade_receive();
 	if(s == INVALID_SOCKET) {
-		fprintf(stderr,
-			"Error: Cannot open server socket on port %d.\n",
-			port);
-		pm_deinit();
-		return 1;
+		s = server_socket_open(&port);
+		if(s == INVALID_SOCKET) {
+			log_write(PMLOG_ERROR, "Cannot open server socket on port %d.",
+				port);
+			pm_deinit();
+			host_deinit();
+			return 1;
+		}
+		listen(s, LIMIT_BACKLOG);
 	}
 
-	c = server_socket_accept(s);
-	if(c == INVALID_SOCKET) {
-		printf("Warning: Client connection not accepted.\n");
-		socket_close(s);
-		pm_deinit();
-		return 1;
-	}
+	timer_start();
+	timer_init(&jobs, serve_jobs, NULL);
+	timer_every(&jobs, JOBS_PERIOD);
 
-	get_addr(c, addr, sizeof(addr)-1);
-	printf("Client %s connected.\n", addr);
-	send(c, ">> ", 4, 0);
-	pm_register(c);
+	/* Sessions taken over from an old binary need their timers. */
+	{
+		unsigned int pos = 0;
+		Session *sess;
+
+		while((sess = session_next(&pos)) != NULL) {
+			session_nonblock(sess->fd);
+			capture_open(sess);
+			timer_init(&sess->idle, serve_idle, sess);
+			timer_add(&sess->idle, SESSION_IDLE);
+		}
+	}
 
 	while(!global_done) {
-		nbytes = recv(c, buf, sizeof(buf)-1, 0);
-		if(nbytes <= 0) {
-			if(!nbytes) {
-				printf("Client disconnected.\n");
-			}
-			socket_close(c);
+		unsigned int pos = 0;
+		Session *sess;
+		int total = 1;
+		int i;
+
+		/* Old binary drains its sessions after an upgrade. */
+		if(!accepting && session_count() == 0) {
+			log_write(PMLOG_INFO, "Upgrade drained, exiting.");
 			break;
 		}
-		else {
-			buf[nbytes] = 0;
-			(void)parse_input(c, buf);
-			if(!global_done) send(c, ">> ", 4, 0);
+
+		/* Clients whose output could not be sent are done. */
+		while((sess = session_next(&pos)) != NULL) {
+			if(sess->dropped && sess->chan == NULL) {
+				serve_close(sess->fd);
+				pos = 0;
+			}
+		}
+
+		fds[0].fd = accepting ? s : INVALID_SOCKET;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		pos = 0;
+		while((sess = session_next(&pos)) != NULL) {
+			if(sess->chan != NULL) {
+				continue;
+			}
+
+			/* Plain sessions read no more commands until their
+			 * output is gone, channels are held back by credit.
+			 */
+			fds[total].fd = sess->fd;
+			fds[total].events = 0;
+			if(sess->wlen == 0 || sess->mux != NULL) {
+				fds[total].events |= POLLIN;
+			}
+			if(sess->wlen > 0) {
+				fds[total].events |= POLLOUT;
+			}
+			fds[total].revents = 0;
+			++total;
+		}
+
+		if(poll(fds, total, timer_next()) < 0) {
+			continue;
+		}
+		timer_advance();
+
+		for(i = 1; i < total && !global_done; i++) {
+			if(!fds[i].revents) {
+				continue;
+			}
+			sess = session_get(fds[i].fd);
+			if(sess == NULL) {
+				continue;
+			}
+			if((fds[i].revents & POLLOUT) && session_flush(sess) < 0) {
+				serve_close(fds[i].fd);
+				continue;
+			}
+			if((fds[i].revents & ~POLLOUT) && serve_input(sess) < 0) {
+				serve_close(fds[i].fd);
+			}
+		}
+		if(!global_done && accepting && (fds[0].revents & POLLIN)) {
+			serve_accept(s);
+		}
+
+		/* Safe point, no request is running. */
+		if(!global_done && accepting && upgrade_pending()
+				&& upgrade_run(s) == 0) {
+			socket_close(s);
+			accepting = 0;
 		}
 	}
 
-	printf("Client %s disconnected.\n", addr);
-	socket_close(s);
+	if(global_done) {
+		log_write(PMLOG_INFO, "Shutting down.");
+	}
+	{
+		unsigned int pos = 0;
+		Session *sess;
+
+		while((sess = session_next(&pos)) != NULL) {
+			serve_close(sess->fd);
+			pos = 0;
+		}
+	}
+	timer_cancel(&jobs);
+	capture_stop();
+	if(accepting) {
+		socket_close(s);
+	}
+	batch_deinit();
 	pm_deinit();
+	host_deinit();
+	store_clear();
 #if defined(_WIN32) || defined(_WIN64)
 	WSACleanup();
 #endif
@@ -0,0 +1,294 @@
+/*
+ * mem.c - Source for memory accounting per owner and per session.
+ *
+ * Every block starts with a header naming its owner and the session it
+ * was charged to, so a free comes off the right counters even when it
+ * happens long after the command that allocated it. Owners that hold
+ * bookkeeping of the server itself are shared and never charged to the
+ * session that happened to cause them. Sessions at their cap get their
+ * allocations refused and their commands rejected instead of growing
+ * the process. Only used from the main thread.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "parse.h"
+#include "plugin.h"
+
+/* Block header definition and typedef, keeps the data aligned. */
+union MemHeader {
+	struct {
+		size_t size;
+		unsigned int owner;
+		unsigned int session;
+		SOCKET fd;
+	} h;
+	max_align_t align;
+};
+typedef union MemHeader MemHeader;
+
+static MemStats owners[MEM_OWNERS];
+static int owner_count;
+static MemStats commands[MEM_COMMANDS];
+static int command_count;
+static const Command *command_last;
+static int command_lastidx;
+static SOCKET charged_fd = INVALID_SOCKET;
+static unsigned int charged_id;
+static unsigned long cap = MEM_SESSION_CAP;
+
+/* Owners that belong to the server rather than to a session. */
+static const char *shared[] = {
+	MEM_SESSIONS,
+	MEM_SCRIPTS,
+	PMMEM_INDEX,
+	PMMEM_PLUGINS
+};
+
+/* Find an owner by name, adding it if needed.
+ */
+static int mem_find(const char *name)
+{
+	const unsigned int len = sizeof(owners[0].name) - 1;
+	unsigned int i;
+	int n;
+
+	if(owner_count == 0) {
+		snprintf(owners[0].name, sizeof(owners[0].name), "other");
+		owner_count = 1;
+	}
+	if(name == NULL) {
+		return 0;
+	}
+	for(n = 0; n < owner_count; n++) {
+		if(!strncmp(owners[n].name, name, len)) {
+			return n;
+		}
+	}
+	if(owner_count >= MEM_OWNERS) {
+		return 0;
+	}
+
+	snprintf(owners[n].name, sizeof(owners[n].name), "%s", name);
+	for(i = 0; i < sizeof(shared) / sizeof(shared[0]); i++) {
+		if(!strcmp(shared[i], name)) {
+			owners[n].shared = 1;
+		}
+	}
+	return owner_count++;
+}
+
+/* Count bytes allocated by the running command.
+ */
+static void mem_count(size_t bytes)
+{
+	const Command *cmd = parse_current();
+	const unsigned int len = sizeof(commands[0].name) - 1;
+	int n;
+
+	if(cmd == NULL) {
+		return;
+	}
+	if(cmd == command_last
+			&& !strncmp(commands[command_lastidx].name, cmd->name, len)) {
+		n = command_lastidx;
+	}
+	else {
+		for(n = 0; n < command_count; n++) {
+			if(!strncmp(commands[n].name, cmd->name, len)) {
+				break;
+			}
+		}
+		if(n == command_count) {
+			if(command_count >= MEM_COMMANDS) {
+				return;
+			}
+			snprintf(commands[n].name, sizeof(commands[n].name), "%s",
+				cmd->name);
+			command_count++;
+		}
+		command_last = cmd;
+		command_lastidx = n;
+	}
+	commands[n].bytes += bytes;
+	commands[n].allocs++;
+}
+
+/* Find a session that is still open.
+ */
+static Session *mem_session(const SOCKET fd, unsigned int id)
+{
+	Session *s;
+
+	if(!id) {
+		return NULL;
+	}
+	s = session_get(fd);
+	return s != NULL && s->id == id ? s : NULL;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Allocate memory for an owner, charged to the running session.
+ */
+void *mem_alloc(const char *owner, size_t size)
+{
+	return mem_realloc(owner, NULL, size);
+}
+
+/* Allocate zeroed memory for an owner.
+ */
+void *mem_calloc(const char *owner, size_t n, size_t size)
+{
+	void *ptr;
+
+	if(size && n > (size_t)-1 / size) {
+		return NULL;
+	}
+	if((ptr = mem_realloc(owner, NULL, n * size)) != NULL) {
+		memset(ptr, 0, n * size);
+	}
+	return ptr;
+}
+
+/* Resize memory, a NULL ptr allocates for owner.
+ */
+void *mem_realloc(const char *owner, void *ptr, size_t size)
+{
+	MemHeader *h = NULL;
+	MemStats *o;
+	Session *s;
+	size_t old = 0;
+	int n;
+
+	if(ptr != NULL) {
+		if(size == 0) {
+			mem_free(ptr);
+			return NULL;
+		}
+		h = (MemHeader *)ptr - 1;
+		old = h->h.size;
+		n = h->h.owner;
+		s = mem_session(h->h.fd, h->h.session);
+	}
+	else {
+		n = mem_find(owner);
+		s = owners[n].shared ? NULL
+			: mem_session(charged_fd, charged_id);
+	}
+	o = &owners[n];
+
+	if(s != NULL && cap && size > old && s->mem + (size - old) > cap) {
+		o->failed++;
+		s->mem_failed++;
+		return NULL;
+	}
+	if(size > (size_t)-1 - sizeof(MemHeader)
+			|| (h = (MemHeader *)realloc(h, sizeof(MemHeader) + size))
+			== NULL) {
+		o->failed++;
+		return NULL;
+	}
+	if(ptr == NULL) {
+		h->h.owner = n;
+		h->h.session = s != NULL ? s->id : 0;
+		h->h.fd = s != NULL ? s->fd : INVALID_SOCKET;
+		o->allocs++;
+	}
+	h->h.size = size;
+
+	o->bytes = o->bytes - old + size;
+	if(o->bytes > o->peak) {
+		o->peak = o->bytes;
+	}
+	if(s != NULL) {
+		s->mem = s->mem - old + size;
+		if(s->mem > s->mem_peak) {
+			s->mem_peak = s->mem;
+		}
+	}
+	if(size > old) {
+		mem_count(size - old);
+	}
+	return h + 1;
+}
+
+/* Free memory allocated by this module.
+ */
+void mem_free(void *ptr)
+{
+	MemHeader *h;
+	Session *s;
+
+	if(ptr == NULL) {
+		return;
+	}
+	h = (MemHeader *)ptr - 1;
+	owners[h->h.owner].bytes -= h->h.size;
+	if((s = mem_session(h->h.fd, h->h.session)) != NULL) {
+		s->mem -= h->h.size;
+	}
+	free(h);
+}
+
+/* Charge allocations to a session, returns the one charged before.
+ */
+Session *mem_charge(Session *s)
+{
+	Session *prev = mem_session(charged_fd, charged_id);
+
+	charged_fd = s != NULL ? s->fd : INVALID_SOCKET;
+	charged_id = s != NULL ? s->id : 0;
+	return prev;
+}
+
+/* Check if a session has used up its memory.
+ */
+int mem_exceeded(const Session *s)
+{
+	return s != NULL && cap && s->mem >= cap;
+}
+
+/* Set memory cap of every session.
+ */
+void mem_setcap(unsigned long bytes)
+{
+	cap = bytes;
+}
+
+/* Get memory cap of a session.
+ */
+unsigned long mem_getcap(void)
+{
+	return cap;
+}
+
+/* Get statistics of owner n.
+ */
+int mem_owner(int n, MemStats *stats)
+{
+	if(n < 0 || n >= owner_count) {
+		return -1;
+	}
+	*stats = owners[n];
+	return 0;
+}
+
+/* Get bytes allocated while command n ran.
+ */
+int mem_command(int n, MemStats *stats)
+{
+	if(n < 0 || n >= command_count) {
+		return -1;
+	}
+	*stats = commands[n];
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * mem.h - Header for memory accounting per owner and per session.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stddef.h>
+#include "prs/network.h"
+#include "session.h"
+
+/* Most owners tracked, later ones are counted as 'other'. */
+#define MEM_OWNERS 64
+/* Most commands tracked. */
+#define MEM_COMMANDS 128
+/* Default memory cap of a session in bytes, zero is no cap. */
+#define MEM_SESSION_CAP (4*1024*1024)
+
+/* Owners of server memory, plugin owners are named in plugin.h. */
+#define MEM_IO "io"
+#define MEM_SESSIONS "sessions"
+#define MEM_BATCH "batch"
+#define MEM_SCRIPTS "scripts"
+
+/* Memory statistics of an owner or command definition and typedef. */
+struct MemStats {
+	char name[32];
+	unsigned long bytes;
+	unsigned long peak;
+	unsigned long allocs;
+	unsigned long failed;
+	int shared;
+};
+typedef struct MemStats MemStats;
+
+/* Allocate memory for an owner, charged to the running session. */
+extern void *mem_alloc(const char *owner, size_t size);
+
+/* Allocate zeroed memory for an owner. */
+extern void *mem_calloc(const char *owner, size_t n, size_t size);
+
+/* Resize memory, a NULL ptr allocates for owner. */
+extern void *mem_realloc(const char *owner, void *ptr, size_t size);
+
+/* Free memory allocated by this module. */
+extern void mem_free(void *ptr);
+
+/* Charge allocations to a session, returns the one charged before. */
+extern Session *mem_charge(Session *s);
+
+/* Check if a session has used up its memory. */
+extern int mem_exceeded(const Session *s);
+
+/* Set memory cap of every session in bytes, zero is no cap. */
+extern void mem_setcap(unsigned long bytes);
+
+/* Get memory cap of a session in bytes. */
+extern unsigned long mem_getcap(void);
+
+/* Get statistics of owner n, returns -1 past the last one. */
+extern int mem_owner(int n, MemStats *stats);
+
+/* Get bytes allocated while command n ran, returns -1 past the last. */
+extern int mem_command(int n, MemStats *stats);
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * output.c - Source for session output with optional compression.
+ *
+ * Responses of framed sessions are sent as frames. Short responses are
+ * held until the response ends and go out as a single raw frame; once a
+ * response crosses OUT_THRESHOLD it is streamed through deflate instead,
+ * one zlib stream per response, so the client can inflate each response
+ * on its own without the server ever buffering all of it.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "output.h"
+#include "trace.h"
+#include "channel.h"
+#include "mem.h"
+
+/* Output stream definition. */
+struct OutStream {
+	int mode;
+	int next;
+	int deflating;
+	int zinit;
+	z_stream zs;
+	unsigned int held;
+	unsigned char hold[OUT_THRESHOLD];
+	unsigned char chunk[OUT_HDRLEN+OUT_CHUNK];
+	int diverting;
+	unsigned char *div;
+	unsigned int divlen;
+	unsigned int divsize;
+	OutStats stats;
+};
+typedef struct OutStream OutStream;
+
+/* Get output stream of a client, creating it if needed.
+ */
+static OutStream *out_get(const SOCKET fd, int create)
+{
+	Session *s = session_get(fd);
+	Session *prev;
+
+	if(s == NULL) {
+		return NULL;
+	}
+	if(s->out == NULL && create) {
+		prev = mem_charge(s);
+		s->out = (OutStream *)mem_calloc(MEM_IO, 1, sizeof(OutStream));
+		mem_charge(prev);
+	}
+	return s->out;
+}
+
+/* Allocate memory for zlib.
+ */
+static voidpf out_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	(void)opaque;
+	return mem_calloc(MEM_IO, items, size);
+}
+
+/* Free memory of zlib.
+ */
+static void out_zfree(voidpf opaque, voidpf ptr)
+{
+	(void)opaque;
+	mem_free(ptr);
+}
+
+/* Get CPU time of the calling thread in seconds, so the logger and
+ * other threads are not counted.
+ */
+static double out_cputime(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	FILETIME created, exited, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	if(!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel,
+			&user)) {
+		return 0.0;
+	}
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (double)(k.QuadPart + u.QuadPart) / 10000000.0;
+#else
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+		return 0.0;
+	}
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+/* Send all the given bytes, what the client does not take right away is
+ * queued on its session.
+ */
+static int out_write(const SOCKET fd, const unsigned char *buf, int len)
+{
+	Session *s = session_get(fd);
+
+	if(s == NULL) {
+		return -1;
+	}
+	if(s->chan != NULL) {
+		return channel_send(s, buf, len);
+	}
+	return session_write(s, buf, len);
+}
+
+/* Send a single frame, header is written in front of data.
+ */
+static int out_frame(const SOCKET fd, OutStream *st, int type,
+	unsigned char *frame, unsigned int len)
+{
+	frame[0] = (unsigned char)type;
+	frame[1] = (len >> 24) & 0xff;
+	frame[2] = (len >> 16) & 0xff;
+	frame[3] = (len >> 8) & 0xff;
+	frame[4] = len & 0xff;
+	st->stats.bytes_out += len + OUT_HDRLEN;
+	return out_write(fd, frame, len + OUT_HDRLEN);
+}
+
+/* Feed data into the deflate stream, sending each chunk as it fills.
+ */
+static int out_deflate(const SOCKET fd, OutStream *st,
+	const unsigned char *buf, unsigned int len, int flush)
+{
+	double start = out_cputime();
+	int rc = 0;
+	int zrc;
+
+	st->zs.next_in = (unsigned char *)buf;
+	st->zs.avail_in = len;
+	do {
+		zrc = deflate(&st->zs, flush);
+		if(zrc == Z_STREAM_ERROR) {
+			rc = -1;
+			break;
+		}
+		if(st->zs.avail_out == 0
+				|| (flush == Z_FINISH && zrc == Z_STREAM_END)) {
+			unsigned int have = OUT_CHUNK - st->zs.avail_out;
+			if(have > 0 && out_frame(fd, st, OUT_FRAME_ZLIB,
+					st->chunk, have) < 0) {
+				rc = -1;
+				break;
+			}
+			st->zs.next_out = st->chunk + OUT_HDRLEN;
+			st->zs.avail_out = OUT_CHUNK;
+		}
+	} while(st->zs.avail_in > 0
+		|| (flush == Z_FINISH && zrc != Z_STREAM_END));
+	st->stats.cpu += out_cputime() - start;
+	return rc;
+}
+
+/* Start deflating the current response, moving held data in first.
+ */
+static int out_begin_deflate(const SOCKET fd, OutStream *st)
+{
+	Session *prev;
+	int rc;
+
+	if(!st->zinit) {
+		st->zs.zalloc = out_zalloc;
+		st->zs.zfree = out_zfree;
+		st->zs.opaque = Z_NULL;
+		prev = mem_charge(session_get(fd));
+		rc = deflateInit(&st->zs, Z_DEFAULT_COMPRESSION);
+		/* Near its memory cap a session gets a small window instead. */
+		if(rc == Z_MEM_ERROR) {
+			rc = deflateInit2(&st->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				OUT_SMALL_WINDOW, 1, Z_DEFAULT_STRATEGY);
+		}
+		mem_charge(prev);
+		if(rc != Z_OK) {
+			return -1;
+		}
+		st->zinit = 1;
+	}
+	else {
+		deflateReset(&st->zs);
+	}
+	st->zs.next_out = st->chunk + OUT_HDRLEN;
+	st->zs.avail_out = OUT_CHUNK;
+	st->deflating = 1;
+	st->stats.compressed++;
+	if(st->held > 0) {
+		unsigned int held = st->held;
+		st->held = 0;
+		return out_deflate(fd, st, st->hold, held, Z_NO_FLUSH);
+	}
+	return 0;
+}
+
+/* Add output to the collected output of a client.
+ */
+static int out_append(OutStream *st, const void *buf, int len)
+{
+	unsigned int size = st->divsize ? st->divsize : 1024;
+	unsigned char *tmp;
+
+	if(len <= 0) {
+		return 0;
+	}
+	while(size < st->divlen + len) {
+		size *= 2;
+	}
+	if(size != st->divsize) {
+		if((tmp = (unsigned char *)mem_realloc(MEM_IO, st->div, size))
+				== NULL) {
+			return -1;
+		}
+		st->div = tmp;
+		st->divsize = size;
+	}
+	memcpy(st->div + st->divlen, buf, len);
+	st->divlen += len;
+	return len;
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Send response data to a client.
+ */
+int out_send(const SOCKET fd, const void *buf, int len)
+{
+	Session *s = session_get(fd);
+	OutStream *st = s != NULL ? s->out : NULL;
+
+	if(st != NULL && st->diverting) {
+		return out_append(st, buf, len);
+	}
+	if(s != NULL && len > 0) {
+		s->sent += len;
+	}
+
+	if(st == NULL || st->mode == OUT_RAW) {
+		unsigned long long span = trace_begin(fd);
+		int rc;
+
+		/* Channels carry their output in frames of the connection. */
+		if(s != NULL && s->chan != NULL) {
+			rc = channel_send(s, buf, len);
+		}
+		else if(s != NULL) {
+			rc = len > 0 ? session_write(s, buf, len) : 0;
+		}
+		else {
+			rc = send(fd, (const char *)buf, len, 0);
+		}
+		trace_end(fd, "send", span);
+		return rc;
+	}
+	if(len <= 0) {
+		return 0;
+	}
+
+	st->stats.bytes_in += len;
+	if(!st->deflating) {
+		if(st->held + len <= OUT_THRESHOLD) {
+			memcpy(st->hold + st->held, buf, len);
+			st->held += len;
+			return len;
+		}
+		if(out_begin_deflate(fd, st) < 0) {
+			return -1;
+		}
+	}
+	if(out_deflate(fd, st, (const unsigned char *)buf, len,
+			Z_NO_FLUSH) < 0) {
+		return -1;
+	}
+	return len;
+}
+
+/* Finish the current response, flushing held data.
+ */
+int out_end(const SOCKET fd)
+{
+	OutStream *st = out_get(fd, 0);
+	unsigned long long span;
+	int rc = 0;
+
+	if(st == NULL) {
+		return 0;
+	}
+
+	span = trace_begin(fd);
+	if(st->mode == OUT_FRAMED) {
+		if(st->deflating) {
+			rc = out_deflate(fd, st, NULL, 0, Z_FINISH);
+			st->deflating = 0;
+		}
+		else if(st->held > 0) {
+			unsigned char frame[OUT_HDRLEN+OUT_THRESHOLD];
+			memcpy(frame + OUT_HDRLEN, st->hold, st->held);
+			rc = out_frame(fd, st, OUT_FRAME_RAW, frame, st->held);
+		}
+		st->held = 0;
+		st->stats.responses++;
+	}
+	trace_end(fd, "send", span);
+	st->mode = st->next;
+	return rc < 0 ? -1 : 0;
+}
+
+/* Switch output mode after the current response.
+ */
+int out_setmode(const SOCKET fd, int mode)
+{
+	OutStream *st = out_get(fd, 1);
+
+	if(st == NULL || (mode != OUT_RAW && mode != OUT_FRAMED)) {
+		return -1;
+	}
+	st->next = mode;
+	return 0;
+}
+
+/* Get output mode of a client.
+ */
+int out_getmode(const SOCKET fd)
+{
+	OutStream *st = out_get(fd, 0);
+	return st != NULL ? st->mode : OUT_RAW;
+}
+
+/* Get output statistics of a client.
+ */
+int out_stats(const SOCKET fd, OutStats *stats)
+{
+	OutStream *st = out_get(fd, 0);
+
+	if(stats == NULL) {
+		return -1;
+	}
+	if(st == NULL) {
+		memset(stats, 0, sizeof(OutStats));
+		return 0;
+	}
+	*stats = st->stats;
+	return 0;
+}
+
+/* Collect output of a client instead of sending it.
+ */
+int out_divert(const SOCKET fd)
+{
+	OutStream *st = out_get(fd, 1);
+
+	if(st == NULL || st->diverting) {
+		return -1;
+	}
+	st->diverting = 1;
+	st->divlen = 0;
+	return 0;
+}
+
+/* Stop collecting output, returns its length and sets buf to it.
+ */
+int out_collect(const SOCKET fd, const unsigned char **buf)
+{
+	OutStream *st = out_get(fd, 0);
+
+	if(st == NULL || !st->diverting) {
+		return -1;
+	}
+	st->diverting = 0;
+	*buf = st->div;
+	return st->divlen;
+}
+
+/* Free output state of a session.
+ */
+void out_free(Session *s)
+{
+	if(s != NULL && s->out != NULL) {
+		if(s->out->zinit) {
+			deflateEnd(&s->out->zs);
+		}
+		mem_free(s->out->div);
+		mem_free(s->out);
+		s->out = NULL;
+	}
+}
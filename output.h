@@ -0,0 +1,65 @@
+/*
+ * output.h - Header for session output with optional compression.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include "prs/network.h"
+#include "session.h"
+
+/* Responses smaller than this are sent without compression. */
+#define OUT_THRESHOLD 1024
+/* Size of a compressed chunk sent on the wire. */
+#define OUT_CHUNK 16384
+/* Frame header: one type byte and a four byte big endian length. */
+#define OUT_HDRLEN 5
+/* Window bits used when a session is short of memory. */
+#define OUT_SMALL_WINDOW 9
+
+/* Output modes and frame types. */
+enum { OUT_RAW, OUT_FRAMED };
+enum { OUT_FRAME_RAW = 'R', OUT_FRAME_ZLIB = 'Z' };
+
+/* Output statistics definition and typedef, cpu is seconds of CPU time
+ * of the server thread spent compressing. */
+struct OutStats {
+	unsigned long responses;
+	unsigned long compressed;
+	unsigned long bytes_in;
+	unsigned long bytes_out;
+	double cpu;
+};
+typedef struct OutStats OutStats;
+
+/* Send response data to a client. */
+extern int out_send(const SOCKET fd, const void *buf, int len);
+
+/* Finish the current response, flushing held data. */
+extern int out_end(const SOCKET fd);
+
+/* Switch output mode after the current response. */
+extern int out_setmode(const SOCKET fd, int mode);
+
+/* Get output mode of a client. */
+extern int out_getmode(const SOCKET fd);
+
+/* Get output statistics of a client. */
+extern int out_stats(const SOCKET fd, OutStats *stats);
+
+/* Collect output of a client instead of sending it. */
+extern int out_divert(const SOCKET fd);
+
+/* Stop collecting output, returns its length and sets buf to it, which
+ * stays valid until the next out_divert(). */
+extern int out_collect(const SOCKET fd, const unsigned char **buf);
+
+/* Free output state of a session. */
+extern void out_free(Session *s);
+
+#endif
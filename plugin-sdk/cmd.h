@@ -13,8 +13,16 @@
 #include "prs/network.h"
 
 #define CMD_DEF(X) static int cmd_ ##X (const SOCKET fd, const Argument *args)
-#define CMD_ADD1(X,A,M) { #X, A, M, cmd_ ##X }
-#define CMD_ADD2(X,A,M,F) { #X, A, M, cmd_ ##F }
+#define CMD_ADD1(X,A,M) { #X, A, M, cmd_ ##X, 0, 0 }
+#define CMD_ADD2(X,A,M,F) { #X, A, M, cmd_ ##F, 0, 0 }
+#define CMD_ADD3(X,A,M,T) { #X, A, M, cmd_ ##X, T, 0 }
+#define CMD_ADD4(X,A,M,T,F) { #X, A, M, cmd_ ##X, T, F }
+
+/* Default command deadline in milliseconds. */
+#define CMD_TIMEOUT 10000
+
+/* Command flag, only its full name runs it and never an abbreviation. */
+#define CMD_EXACT 0x1
 
 /* Argument definition and typedef. */
 union Argument {
@@ -30,6 +38,8 @@ struct Command {
 	const char *args;
 	const char *help;
 	int (*func)(const SOCKET fd, const Argument *args);
+	unsigned int timeout;
+	unsigned int flags;
 };
 typedef struct Command Command;
 
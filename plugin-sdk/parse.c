@@ -11,20 +11,47 @@
 #include <stdlib.h>
 #include "parse.h"
 #include "plugin.h"
+#include "trie.h"
+
+/* Command name list definition and typedef. */
+struct NameList {
+	char buf[256];
+	unsigned int len;
+	unsigned int count;
+};
+typedef struct NameList NameList;
 
 static Command *cmds;
 static int CMD_CNT;
 
+/* Command that is running. */
+static const Command *current;
+
+/* Messages for results of parse_prepare(). */
+static const char *messages[] = {
+	"",
+	"No command entered!\r\n",
+	"Bad command.\r\n",
+	"Ambiguous command.\r\n",
+	"Bad argument(s).\r\n"
+};
+
+/* Index over builtin and plugin commands. */
+static Trie cmd_index;
+static unsigned int index_gen;
+static int index_ready;
+
 /* Initialize the parser for commands.
  */
 void parse_init(Command *commands, int total)
 {
 	cmds = commands;
 	CMD_CNT = total;
+	index_ready = 0;
 }
 
 #define ESCAPE \
-	free(args); \
+	pm_free(args); \
 	return NULL
 /* Parse command line arguments from given argument string.
  */
@@ -36,7 +63,8 @@ Argument *arg_parser(const char *s)
 	cnt = strlen(s);
 	if(!cnt) return NULL;
 
-	args = (Argument *)malloc(cnt * sizeof(Argument));
+	args = (Argument *)pm_malloc(PMMEM_PARSER,
+		(cnt + 1) * sizeof(Argument));
 	if(!args) return NULL;
 
 	for(i = 0; i < cnt; i++) {
@@ -64,6 +92,10 @@ Argument *arg_parser(const char *s)
 				}
 				args[i].f = atof(tok);
 			break;
+			case 'r':
+				tok = strtok(NULL, DELIM_REST);
+				args[i].s = tok ? tok : "";
+			break;
 			default:
 				ESCAPE;
 			break;
@@ -74,52 +106,222 @@ Argument *arg_parser(const char *s)
 }
 #undef ESCAPE
 
+/* Add a plugin command to the index.
+ */
+static void parse_add(const Command *cmd, void *arg)
+{
+	(void)trie_insert((Trie *)arg, cmd);
+}
+
+/* Get the command index, rebuilt when plugins have changed.
+ */
+static const Trie *parse_index(void)
+{
+	if(!index_ready || index_gen != pm_generation()) {
+		int i;
+
+		trie_free(&cmd_index);
+		for(i = 0; i < CMD_CNT; i++) {
+			(void)trie_insert(&cmd_index, &cmds[i]);
+		}
+		pm_commands(parse_add, &cmd_index);
+		index_gen = pm_generation();
+		index_ready = 1;
+	}
+	return &cmd_index;
+}
+
+/* Collect names of matching commands.
+ */
+static void parse_names(const Command *cmd, void *arg)
+{
+	NameList *list = (NameList *)arg;
+	int len;
+
+	if(list->len >= sizeof(list->buf) - 1) {
+		return;
+	}
+	len = snprintf(list->buf + list->len, sizeof(list->buf) - list->len,
+		"%s%s", list->count++ ? ", " : "", cmd->name);
+	list->len += len;
+	if(list->len > sizeof(list->buf) - 1) {
+		list->len = sizeof(list->buf) - 1;
+	}
+}
+
+/* Send the name of a completion to the client.
+ */
+static void parse_completion(const Command *cmd, void *arg)
+{
+	const SOCKET fd = *(const SOCKET *)arg;
+	char buf[128];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%s\r\n", cmd->name);
+	if(len > 0 && len < (int)sizeof(buf)) {
+		pm_send(fd, buf, len);
+	}
+}
+
+/* Call a command under its deadline.
+ */
+static int parse_call(const SOCKET fd, const Command *cmd,
+	const Argument *args)
+{
+	unsigned long long span = pm_trace_begin(fd);
+	const Command *prev = current;
+	int rc;
+
+	pm_deadline(fd, cmd->timeout ? cmd->timeout : CMD_TIMEOUT);
+	current = cmd;
+	rc = cmd->func(fd, args);
+	current = prev;
+	if(pm_cancelled(fd)) {
+		pm_send(fd, "Command timed out.\r\n", 20);
+	}
+	pm_deadline(fd, 0);
+	pm_trace_end(fd, cmd->name, span);
+	return rc;
+}
+
+/* Run a resolved command with the rest of the line as arguments.
+ */
+static int parse_run(const SOCKET fd, const Command *cmd,
+	unsigned long long span)
+{
+	Argument *args;
+	char *tok;
+	int rc;
+
+	if(pm_admit(fd, cmd->name)) {
+		pm_trace_end(fd, "parse", span);
+		pm_send(fd, "Busy, try again later.\r\n", 24);
+		return 1;
+	}
+
+	args = arg_parser(cmd->args);
+	if(args == NULL && strlen(cmd->args)) {
+		pm_trace_end(fd, "parse", span);
+		pm_send(fd, "Bad argument(s).\r\n", 18);
+		return 1;
+	}
+
+	tok = strtok(NULL, DELIM);
+	pm_trace_end(fd, "parse", span);
+	if(tok != NULL) {
+		pm_send(fd, "Bad argument(s).\r\n", 18);
+		pm_free(args);
+		return 1;
+	}
+
+	rc = parse_call(fd, cmd, args);
+	pm_free(args);
+	return rc;
+}
+
 /* String parser for this command interpreter.
  */
 int parse_input(const SOCKET fd, char *string)
 {
+	unsigned long long span = pm_trace_begin(fd);
+	const Command *cmd;
+	const Trie *t;
+	NameList list;
 	char *tok;
-	int i;
+	int found;
 
 	tok = strtok(string, DELIM);
 	if(!tok) {
-		send(fd, "No command entered!\r\n", 21, 0);
+		pm_trace_end(fd, "parse", span);
+		pm_send(fd, "No command entered!\r\n", 21);
 		return 1;
 	}
 
-	i = CMD_CNT;
-	while(i--) {
-		const Command *cmd = &cmds[i];
-		
-		if(!strcmp(tok, cmd->name)) {
-			Argument *args = arg_parser(cmd->args);
-			int rc;
-
-			if(args == NULL && strlen(cmd->args)) {
-				send(fd, "Bad argument(s).\r\n", 18, 0);
-				return 1;
-			}
-
-			tok = strtok(NULL, DELIM);
-			if(tok != NULL) {
-				send(fd, "Bad argument(s).\r\n", 18, 0);
-				free(args);
-				return 1;
-			}
-
-			rc = cmd->func(fd, args);
-			free(args);
-			return rc;
-		}
+	t = parse_index();
+	found = trie_find(t, tok, &cmd);
+	if(found == 1) {
+		return parse_run(fd, cmd, span);
 	}
+	pm_trace_end(fd, "parse", span);
 
-	/* Process other commands from external plugins. */
-	{
-		int rc = pm_register_commands(tok, fd);
-		if(rc >= 0) return rc;
+	if(found == 0) {
+		pm_send(fd, "Bad command.\r\n", 14);
+		return 1;
 	}
 
-	send(fd, "Bad command.\r\n", 14, 0);
+	/* Tell the client what it could have meant. */
+	list.len = snprintf(list.buf, sizeof(list.buf), "Ambiguous command: ");
+	list.count = 0;
+	(void)trie_walk(t, tok, parse_names, &list);
+	pm_send(fd, list.buf, list.len);
+	pm_send(fd, ".\r\n", 3);
 	return 1;
 }
 
+/* Resolve a command string without running it.
+ */
+int parse_prepare(char *string, const Command **cmd, Argument **args)
+{
+	char *tok;
+
+	*args = NULL;
+	if((tok = strtok(string, DELIM)) == NULL) {
+		return PARSE_EMPTY;
+	}
+	switch(trie_find(parse_index(), tok, cmd)) {
+		case 0:
+			return PARSE_UNKNOWN;
+		case 1:
+		break;
+		default:
+			return PARSE_AMBIGUOUS;
+	}
+
+	*args = arg_parser((*cmd)->args);
+	if(*args == NULL && strlen((*cmd)->args)) {
+		return PARSE_ARGS;
+	}
+	if(strtok(NULL, DELIM) != NULL) {
+		pm_free(*args);
+		*args = NULL;
+		return PARSE_ARGS;
+	}
+	return PARSE_OK;
+}
+
+/* Run a command resolved by parse_prepare().
+ */
+int parse_exec(const SOCKET fd, const Command *cmd, const Argument *args)
+{
+	if(pm_admit(fd, cmd->name)) {
+		pm_send(fd, "Busy, try again later.\r\n", 24);
+		return 1;
+	}
+	return parse_call(fd, cmd, args);
+}
+
+/* Get the message parse_input() sends for a parse_prepare() result.
+ */
+const char *parse_message(int rc)
+{
+	if(rc < 0 || rc >= (int)(sizeof(messages) / sizeof(messages[0]))) {
+		return "";
+	}
+	return messages[rc];
+}
+
+/* Get the command that is running.
+ */
+const Command *parse_current(void)
+{
+	return current;
+}
+
+/* Send every command name starting with prefix.
+ */
+int parse_complete(const SOCKET fd, const char *prefix)
+{
+	SOCKET sock = fd;
+
+	return trie_walk(parse_index(), prefix, parse_completion, &sock);
+}
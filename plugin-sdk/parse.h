@@ -13,12 +13,24 @@
 #include "cmd.h"
 
 #define DELIM " \r\n"
+/* Delimiter of the 'r' argument, which takes the rest of the line. */
+#define DELIM_REST "\r\n"
+
+/* Results of parse_prepare(). */
+enum {
+	PARSE_OK,
+	PARSE_EMPTY,
+	PARSE_UNKNOWN,
+	PARSE_AMBIGUOUS,
+	PARSE_ARGS
+};
 
 #define PARSE_INIT(cmds, size) void command_init(void) { \
 	parse_init(cmds, size); \
 }
 
-/* Parse command line arguments from given argument string. */
+/* Parse command line arguments from given argument string, free the
+ * result with pm_free(). */
 Argument *arg_parser(const char *s);
 
 /* Initialize parser for commands. */
@@ -27,6 +39,23 @@ extern void parse_init(Command *commands, int total);
 /* Parse a given command string. */
 extern int parse_input(const SOCKET fd, char *string);
 
+/* Resolve a command string without running it, args point into string
+ * and are freed with pm_free(). Returns PARSE_OK or what went wrong. */
+extern int parse_prepare(char *string, const Command **cmd, Argument **args);
+
+/* Run a command resolved by parse_prepare(). */
+extern int parse_exec(const SOCKET fd, const Command *cmd,
+	const Argument *args);
+
+/* Get the message parse_input() sends for a parse_prepare() result. */
+extern const char *parse_message(int rc);
+
+/* Get the command that is running, NULL between commands. */
+extern const Command *parse_current(void);
+
+/* Send every command name starting with prefix, returns the count. */
+extern int parse_complete(const SOCKET fd, const char *prefix);
+
 /* Initialize the commands given. */
 extern void command_init(void);
 
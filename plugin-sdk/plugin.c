@@ -21,8 +21,12 @@
 #endif
 
 /* Plugin manager list definition. */
-static CList *pm_list;
+static Plugin *pm_list;
 static int plugin_count;
+static const PluginAPI *pm_services;
+static const Plugin *pm_self;
+static unsigned int generation;
+static const char *isolated;
 
 /* Plugin manager definition. */
 struct Plugin {
@@ -34,9 +38,12 @@ struct Plugin {
 	char *name;
 	Command *cmds;
 	unsigned int cmd_cnt;
+	const PluginAPI *api;
+	unsigned int timeout;
 	short unsigned int id;
 	short unsigned int type;
 	void (*func)(Plugin *self, const SOCKET fd);
+	Plugin *next;
 };
 
 /* Create a new plugin.
@@ -46,12 +53,12 @@ static Plugin *pm_new(void *sym, const char *name,
 {
 	Plugin *pm;
 
-	pm = (Plugin*)malloc(sizeof(Plugin));
+	pm = (Plugin*)pm_malloc(PMMEM_PLUGINS, sizeof(Plugin));
 	if(pm != NULL) {
 		const unsigned int len = strlen(name);
-		pm->name = (char *)malloc(sizeof(char)*(len+1));
+		pm->name = (char *)pm_malloc(PMMEM_PLUGINS, sizeof(char)*(len+1));
 		if(pm->name == NULL) {
-			free(pm);
+			pm_free(pm);
 			return NULL;
 		}
 		memcpy(pm->name, name, len);
@@ -61,24 +68,63 @@ static Plugin *pm_new(void *sym, const char *name,
 		pm->id = plugin_count;
 		pm->cmds = NULL;
 		pm->cmd_cnt = 0;
+		pm->api = pm_services;
+		pm->timeout = 0;
 		pm->sym = sym;
+		pm->next = NULL;
 	}
 	return pm;
 }
 
 /* Free a plugin.
  */
-static void pm_free(void *data)
+static void pm_destroy(Plugin *pm)
 {
-	Plugin *pm = (Plugin *)data;
-
 	if(pm != NULL) {
 		pm->id = 0;
 		pm->type = PMTYPE_UNKNOWN;
 		pm->func = NULL;
-		free(pm->name);
-		free(pm);
+		pm_free(pm->name);
+		pm_free(pm);
+	}
+}
+
+/* Add a plugin to the end of the list.
+ */
+static void pm_add(Plugin *pm)
+{
+	Plugin **link = &pm_list;
+
+	while(*link != NULL) {
+		link = &(*link)->next;
 	}
+	*link = pm;
+	++plugin_count;
+	++generation;
+}
+
+/* Check if a plugin file name is on the isolation list.
+ */
+static int pm_listed(const char *list, const char *name)
+{
+	const char *end = strchr(name, '.');
+	unsigned int len = end != NULL ? (unsigned int)(end - name)
+		: strlen(name);
+
+	while(list != NULL && *list) {
+		unsigned int n = strcspn(list, ",");
+
+		if((n == 1 && *list == '*') || (n == strlen(name)
+				&& !strncmp(list, name, n))
+				|| (n == len && !strncmp(list, name, n))) {
+			return 1;
+		}
+		list += n;
+		if(*list == ',') {
+			++list;
+		}
+	}
+	return 0;
 }
 
 /* Discover plugins in given directory.
@@ -89,18 +135,13 @@ static int pm_load(const char *dirname)
 	DIR *dir;
 
 	if((dir = opendir(dirname)) == NULL) {
-		printf("Gets here.\n");
+		pm_log(PMLOG_ERROR, "Cannot open plugin directory: %s",
+			dirname);
 		return -1;
 	}
 
 	while((p = readdir(dir)) != NULL) {
 		char path[2048];
-		Plugin *plugin = NULL;
-#if defined(_WIN32) || defined(_WIN64)
-		HANDLE sym = NULL;
-#else
-		void *sym = NULL;
-#endif
 
 		/* Do not get current directory or previous. */
 		if((strncmp(p->d_name, ".", 2)
@@ -118,35 +159,13 @@ static int pm_load(const char *dirname)
 		}
 #endif
 
-		snprintf(path, sizeof(path)-1, "%s/%s", dirname, p->d_name);
-#if defined(_WIN32) || defined(_WIN64)
-		/* Load plugin into list. */
-		sym = LoadLibrary(path);
-		if(sym != NULL) {
-			void *func = GetProcAddress(sym, "init");
-			if(func != NULL) {
-				plugin = pm_new(sym, p->d_name, PMTYPE_UNKNOWN, func);
-				if(plugin != NULL) {
-					clist_add(&pm_list, CLIST_TYPE_STRUCT, plugin, pm_free);
-					++plugin_count;
-					printf("Loaded plugin: %s\n", path);
-				}
-			}
-		}
-#else
-		/* Load plugin into list. */
-		sym = dlopen(path, RTLD_LAZY);
-		if(sym != NULL) {
-			void *func = dlsym(sym, "init");
-			if(func != NULL) {
-				plugin = pm_new(sym, p->d_name, PMTYPE_UNKNOWN, func);
-				if(plugin != NULL) {
-					clist_add(&pm_list, CLIST_TYPE_STRUCT, plugin, pm_free);
-					++plugin_count;
-				}
-			}
+		/* Isolated plugins run in a host process instead. */
+		if(pm_isolated(p->d_name)) {
+			continue;
 		}
-#endif
+
+		snprintf(path, sizeof(path)-1, "%s/%s", dirname, p->d_name);
+		(void)pm_open(path);
 	}
 	closedir(dir);
 	return 0;
@@ -158,11 +177,12 @@ static int pm_load(const char *dirname)
  */
 int pm_init(const char *dirname)
 {
+	++generation;
 	if(pm_load(dirname) < 0) {
-		printf("Cannot initialize plugins.\n");
+		pm_log(PMLOG_ERROR, "Cannot initialize plugins.");
 		return -1;
 	}
-	printf("Total plugins loaded %d.\n", plugin_count);
+	pm_log(PMLOG_INFO, "Total plugins loaded %d.", plugin_count);
 	return 0;
 }
 
@@ -170,117 +190,162 @@ int pm_init(const char *dirname)
  */
 void pm_deinit(void)
 {
-	CList *tmp = pm_list;
+	while(pm_list != NULL) {
+		Plugin *plugin = pm_list;
 
-	while(tmp != NULL) {
-		Plugin *plugin = (Plugin *)clist_getdata(tmp);
-		if(plugin != NULL) {
+		pm_list = plugin->next;
+		if(plugin->sym != NULL) {
 #if defined(_WIN32) || defined(_WIN64)
 			FreeLibrary(plugin->sym);
 #else
 			dlclose(plugin->sym);
 #endif
-			--plugin_count;
 		}
-		tmp = clist_getnext(tmp);
+		--plugin_count;
+		pm_destroy(plugin);
 	}
-	clist_free(pm_list);
-	pm_list = NULL;
-	printf("Plugins deactivated.\n");
+	++generation;
+	pm_log(PMLOG_INFO, "Plugins deactivated.");
+}
+
+/* Load a single plugin file.
+ */
+Plugin *pm_open(const char *path)
+{
+	const char *name = strrchr(path, '/');
+	Plugin *plugin = NULL;
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE sym = NULL;
+#else
+	void *sym = NULL;
+#endif
+
+	name = name != NULL ? name + 1 : path;
+#if defined(_WIN32) || defined(_WIN64)
+	/* Load plugin into list. */
+	sym = LoadLibrary(path);
+	if(sym != NULL) {
+		void *func = GetProcAddress(sym, "init");
+		if(func != NULL) {
+			plugin = pm_new(sym, name, PMTYPE_UNKNOWN, func);
+			if(plugin != NULL) {
+				pm_add(plugin);
+				pm_log(PMLOG_INFO, "Loaded plugin: %s", path);
+			}
+		}
+	}
+#else
+	/* Load plugin into list. */
+	sym = dlopen(path, RTLD_LAZY);
+	if(sym != NULL) {
+		void *func = dlsym(sym, "init");
+		if(func != NULL) {
+			plugin = pm_new(sym, name, PMTYPE_UNKNOWN, func);
+			if(plugin != NULL) {
+				pm_add(plugin);
+			}
+		}
+	}
+#endif
+	++generation;
+	return plugin;
+}
+
+/* Add a plugin that is not loaded into this process.
+ */
+Plugin *pm_attach(const char *name, short unsigned int type,
+	void (*func)(Plugin *self, const SOCKET fd))
+{
+	Plugin *plugin = pm_new(NULL, name, type, func);
+
+	if(plugin != NULL) {
+		pm_add(plugin);
+	}
+	return plugin;
+}
+
+/* Set plugins to skip when loading, a comma separated list.
+ */
+void pm_isolate(const char *list)
+{
+	isolated = list;
+}
+
+/* Check if a plugin is isolated from this process.
+ */
+int pm_isolated(const char *name)
+{
+	return pm_listed(isolated, name);
 }
 
 /* Register plugin help for command plugins.
  */
 void pm_register_help(const SOCKET fd)
 {
-	CList *tmp = pm_list;
-	AppendBuffer *ab;
-	char buf[1024];
-	unsigned int len;
+	Plugin *plugin;
 
-	while(tmp != NULL) {
-		Plugin *plugin = (Plugin *)clist_getdata(tmp);
-		if(plugin != NULL && plugin->type == PMTYPE_COMMAND) {
-			const char *tmp = NULL;
+	for(plugin = pm_list; plugin != NULL; plugin = plugin->next) {
+		if(plugin->type == PMTYPE_COMMAND) {
+			unsigned int size = 1;
+			unsigned int len = 0;
 			unsigned int i;
+			char *buf;
 
-			ab = ab_init();
 			for(i = 0; i < plugin->cmd_cnt; i++) {
-				len = snprintf(buf, sizeof(buf) - 1,
+				size += snprintf(NULL, 0, "%-10s - [%-5s]: %s\r\n",
+					plugin->cmds[i].name,
+					plugin->cmds[i].args,
+					plugin->cmds[i].help);
+			}
+			if((buf = (char *)pm_malloc(PMMEM_HELP, size)) == NULL) {
+				continue;
+			}
+			for(i = 0; i < plugin->cmd_cnt; i++) {
+				len += snprintf(buf + len, size - len,
 					"%-10s - [%-5s]: %s\r\n",
 					plugin->cmds[i].name,
 					plugin->cmds[i].args,
 					plugin->cmds[i].help);
-				ab_append(ab, buf, len);
 			}
-			tmp = (const char *)ab_getdata(ab);
-			send(fd, tmp, strlen(tmp), 0);
-			ab_free(ab);
+			pm_send(fd, buf, len);
+			pm_free(buf);
 		}
-		tmp = clist_getnext(tmp);
 	}
 }
 
-/* Register commands from command plugin.
+/* Call func for every command of the command plugins.
  */
-int pm_register_commands(const char *tok, const SOCKET fd)
+void pm_commands(void (*func)(const Command *cmd, void *arg), void *arg)
 {
-	CList *tmp = pm_list;
+	Plugin *plugin;
 
-	while(tmp != NULL) {
-		Plugin *plugin = (Plugin *)clist_getdata(tmp);
-		if(plugin != NULL && plugin->type == PMTYPE_COMMAND) {
+	for(plugin = pm_list; plugin != NULL; plugin = plugin->next) {
+		if(plugin->type == PMTYPE_COMMAND) {
 			unsigned int i;
 
-			i = plugin->cmd_cnt;
-			while(i--) {
-				const Command *cmd = &plugin->cmds[i];
-
-				if(!strncmp(tok, cmd->name, strlen(tok))) {
-					Argument *args = arg_parser(cmd->args);
-					int rc;
-
-					if(args == NULL && strlen(cmd->args)) {
-						send(fd,
-							"Bad argument(s).\r\n",
-							18, 0);
-						return 1;
-					}
-
-					tok = strtok(NULL, DELIM);
-					if(tok != NULL) {
-						send(fd,
-							"Bad argument(s).\r\n",
-							18, 0);
-						free(args);
-						return 1;
-					}
-
-					rc = cmd->func(fd, args);
-					free(args);
-					return rc;
-				}
+			for(i = 0; i < plugin->cmd_cnt; i++) {
+				func(&plugin->cmds[i], arg);
 			}
 		}
-		tmp = clist_getnext(tmp);
 	}
+}
 
-	send(fd, "Bad command.\r\n", 14, 0);
-	return 1;
+/* Get a counter that changes whenever plugin commands may change.
+ */
+unsigned int pm_generation(void)
+{
+	return generation;
 }
 
 /* Register plugin hook for normal plugins.
  */
 void pm_register(const SOCKET fd)
 {
-	CList *tmp = pm_list;
+	Plugin *plugin;
 
-	while(tmp != NULL) {
-		Plugin *plugin = (Plugin *)clist_getdata(tmp);
-		if(plugin != NULL) {
-			plugin->func(plugin, fd);
-		}
-		tmp = clist_getnext(tmp);
+	++generation;
+	for(plugin = pm_list; plugin != NULL; plugin = plugin->next) {
+		plugin->func(plugin, fd);
 	}
 }
 
@@ -288,46 +353,40 @@ void pm_register(const SOCKET fd)
  */
 void pm_show(const SOCKET fd)
 {
-	CList *tmp = pm_list;
+	Plugin *plugin;
 	char buf[2048];
 	unsigned int total;
 	unsigned int len;
 
 	total = 0;
 	memset(buf, 0, sizeof(buf));
-	while(tmp != NULL) {
-		Plugin *plugin = (Plugin *)clist_getdata(tmp);
-		if(plugin != NULL && plugin->type == PMTYPE_NORMAL) {
+	for(plugin = pm_list; plugin != NULL; plugin = plugin->next) {
+		if(plugin->type == PMTYPE_NORMAL) {
 			len = snprintf(buf+total, sizeof(buf)-1, "%s\r\n",
 					plugin->name);
 			if(len > 0) {
 				total += len;
 			}
 		}
-		tmp = clist_getnext(tmp);
 	}
-	send(fd, buf, len, 0);
+	pm_send(fd, buf, len);
 }
 
 /* Find a specific module by name.
  */
 Plugin *pm_find(const char *name)
 {
-	CList *tmp = pm_list;
-	Plugin *found = NULL;
+	Plugin *plugin;
 
-	while(tmp != NULL) {
-		Plugin *plugin = (Plugin *)clist_getdata(tmp);
-		if(plugin != NULL && plugin->type == PMTYPE_NORMAL) {
+	for(plugin = pm_list; plugin != NULL; plugin = plugin->next) {
+		if(plugin->type == PMTYPE_NORMAL) {
 			const char *name_end = strchr(plugin->name, '.');
 			if(name_end && !memcmp(plugin->name, name, name_end - plugin->name)) {
-				found = plugin;
-				break;
+				return plugin;
 			}
 		}
-		tmp = clist_getnext(tmp);
 	}
-	return found;
+	return NULL;
 }
 
 /* Exec a specific module.
@@ -357,3 +416,209 @@ void pm_settype(Plugin *pm, short unsigned int type)
 		pm->type = type >= PMTYPE_COUNT ? PMTYPE_UNKNOWN : type;
 	}
 }
+
+/* Set the deadline of a module.
+ */
+void pm_settimeout(Plugin *pm, unsigned int ms)
+{
+	if(pm != NULL) {
+		pm->timeout = ms;
+	}
+}
+
+/* Get the deadline of a module.
+ */
+unsigned int pm_gettimeout(const Plugin *pm)
+{
+	return pm != NULL ? pm->timeout : 0;
+}
+
+/* Get the file name of a plugin.
+ */
+const char *pm_getname(const Plugin *pm)
+{
+	return pm != NULL ? pm->name : NULL;
+}
+
+/* Get the type of a plugin.
+ */
+short unsigned int pm_gettype(const Plugin *pm)
+{
+	return pm != NULL ? pm->type : PMTYPE_UNKNOWN;
+}
+
+/* Get the commands of a plugin, returns the count.
+ */
+unsigned int pm_getcommands(const Plugin *pm, Command **cmds)
+{
+	*cmds = pm != NULL ? pm->cmds : NULL;
+	return pm != NULL ? pm->cmd_cnt : 0;
+}
+
+/* Set services handed to plugins.
+ */
+void pm_setapi(const PluginAPI *api)
+{
+	pm_services = api;
+}
+
+/* Bind plugin to the services of the server.
+ */
+void pm_bind(Plugin *pm)
+{
+	if(pm != NULL && pm->api != NULL) {
+		pm_services = pm->api;
+		pm_self = pm;
+	}
+}
+
+/* Send data to a client through the server.
+ */
+int pm_send(const SOCKET fd, const void *buf, int len)
+{
+	if(pm_services != NULL && pm_services->send != NULL) {
+		return pm_services->send(fd, buf, len);
+	}
+	return send(fd, (const char *)buf, len, 0);
+}
+
+/* Log a message through the server logger.
+ */
+void pm_log(int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if(pm_services == NULL || pm_services->log == NULL) {
+		return;
+	}
+	va_start(ap, fmt);
+	pm_services->log(level, fmt, ap);
+	va_end(ap);
+}
+
+/* Set deadline of the running command, zero clears it.
+ */
+void pm_deadline(const SOCKET fd, unsigned int ms)
+{
+	if(pm_services != NULL && pm_services->deadline != NULL) {
+		pm_services->deadline(fd, ms);
+	}
+}
+
+/* Check if the running command should stop.
+ */
+int pm_cancelled(const SOCKET fd)
+{
+	if(pm_services != NULL && pm_services->cancelled != NULL) {
+		return pm_services->cancelled(fd);
+	}
+	return 0;
+}
+
+/* Check rate limits of a command.
+ */
+int pm_admit(const SOCKET fd, const char *name)
+{
+	if(pm_services != NULL && pm_services->admit != NULL) {
+		return pm_services->admit(fd, name);
+	}
+	return 0;
+}
+
+/* Get a value from the store of the server.
+ */
+int pm_store_get(const char *key, void *buf, int len)
+{
+	if(pm_services != NULL && pm_services->store_get != NULL) {
+		return pm_services->store_get(key, buf, len);
+	}
+	return -1;
+}
+
+/* Set a value in the store of the server.
+ */
+int pm_store_set(const char *key, const void *val, int len,
+	unsigned int ttl)
+{
+	if(pm_services != NULL && pm_services->store_set != NULL) {
+		return pm_services->store_set(key, val, len, ttl);
+	}
+	return -1;
+}
+
+/* Delete a value from the store of the server.
+ */
+int pm_store_del(const char *key)
+{
+	if(pm_services != NULL && pm_services->store_del != NULL) {
+		return pm_services->store_del(key);
+	}
+	return -1;
+}
+
+/* Allocate memory accounted to owner, NULL for the calling plugin.
+ */
+void *pm_malloc(const char *owner, size_t size)
+{
+	return pm_realloc(owner, NULL, size);
+}
+
+/* Allocate zeroed memory accounted to owner.
+ */
+void *pm_calloc(const char *owner, size_t n, size_t size)
+{
+	void *ptr;
+
+	if(size && n > (size_t)-1 / size) {
+		return NULL;
+	}
+	if((ptr = pm_realloc(owner, NULL, n * size)) != NULL) {
+		memset(ptr, 0, n * size);
+	}
+	return ptr;
+}
+
+/* Resize memory from pm_malloc(), a NULL ptr allocates for owner.
+ */
+void *pm_realloc(const char *owner, void *ptr, size_t size)
+{
+	if(owner == NULL) {
+		owner = pm_self != NULL ? pm_self->name : PMMEM_PLUGINS;
+	}
+	if(pm_services != NULL && pm_services->mem_realloc != NULL) {
+		return pm_services->mem_realloc(owner, ptr, size);
+	}
+	return realloc(ptr, size);
+}
+
+/* Free memory from pm_malloc().
+ */
+void pm_free(void *ptr)
+{
+	if(pm_services != NULL && pm_services->mem_free != NULL) {
+		pm_services->mem_free(ptr);
+	}
+	else {
+		free(ptr);
+	}
+}
+
+/* Begin a trace span, returns zero if the request is not traced.
+ */
+unsigned long long pm_trace_begin(const SOCKET fd)
+{
+	if(pm_services != NULL && pm_services->trace_begin != NULL) {
+		return pm_services->trace_begin(fd);
+	}
+	return 0;
+}
+
+/* End a trace span started by pm_trace_begin().
+ */
+void pm_trace_end(const SOCKET fd, const char *name,
+	unsigned long long start)
+{
+	if(start && pm_services != NULL && pm_services->trace_end != NULL) {
+		pm_services->trace_end(fd, name, start);
+	}
+}
@@ -10,12 +10,15 @@
 #ifndef _PLUGIN_H_
 #define _PLUGIN_H_
 
+#include <stdarg.h>
+#include <stddef.h>
 #include "prs/network.h"
 #include "prs/abuffer.h"
 #include "prs/clist.h"
 #include "cmd.h"
 
 #define PLUGIN_INIT(A, B, C) void plugin_init(Plugin *pm) { \
+	pm_bind(pm); \
 	pm_set(pm, B, C); \
 	pm_settype(pm, A); \
 	_flag = 1; \
@@ -24,21 +27,116 @@
 /* Blank enumeration for plugin types. */
 enum { PMTYPE_UNKNOWN, PMTYPE_NORMAL, PMTYPE_COMMAND, PMTYPE_COUNT };
 
+/* Log levels for plugins and the server. */
+enum { PMLOG_DEBUG, PMLOG_INFO, PMLOG_WARN, PMLOG_ERROR, PMLOG_COUNT };
+
+/* Owners of memory allocated by the parser and plugin manager. */
+#define PMMEM_PARSER "parser"
+#define PMMEM_INDEX "index"
+#define PMMEM_PLUGINS "plugins"
+#define PMMEM_HELP "help"
+
 /* Plugin manager forward declaration. */
 struct Plugin;
 typedef struct Plugin Plugin;
 
+/* Services the server exports to plugins, new members go at the end. */
+struct PluginAPI {
+	int (*send)(const SOCKET fd, const void *buf, int len);
+	unsigned long long (*trace_begin)(const SOCKET fd);
+	void (*trace_end)(const SOCKET fd, const char *name,
+		unsigned long long start);
+	void (*log)(int level, const char *fmt, va_list ap);
+	void (*deadline)(const SOCKET fd, unsigned int ms);
+	int (*cancelled)(const SOCKET fd);
+	int (*admit)(const SOCKET fd, const char *name);
+	int (*store_get)(const char *key, void *buf, int len);
+	int (*store_set)(const char *key, const void *val, int len,
+		unsigned int ttl);
+	int (*store_del)(const char *key);
+	void *(*mem_realloc)(const char *owner, void *ptr, size_t size);
+	void (*mem_free)(void *ptr);
+};
+typedef struct PluginAPI PluginAPI;
+
+/* Set services handed to plugins, called by the server. */
+extern void pm_setapi(const PluginAPI *api);
+
+/* Bind plugin to the services of the server. */
+extern void pm_bind(Plugin *pm);
+
+/* Send data to a client through the server. */
+extern int pm_send(const SOCKET fd, const void *buf, int len);
+
+/* Log a message through the server logger, dropped without one. */
+extern void pm_log(int level, const char *fmt, ...);
+
+/* Set deadline of the running command, zero clears it. */
+extern void pm_deadline(const SOCKET fd, unsigned int ms);
+
+/* Check if the running command should stop, past its deadline. */
+extern int pm_cancelled(const SOCKET fd);
+
+/* Check rate limits of a command, returns non zero if rejected. */
+extern int pm_admit(const SOCKET fd, const char *name);
+
+/* Get a shared value, returns its full length or -1 if there is none. */
+extern int pm_store_get(const char *key, void *buf, int len);
+
+/* Set a shared value that expires after ttl ms, zero never. */
+extern int pm_store_set(const char *key, const void *val, int len,
+	unsigned int ttl);
+
+/* Delete a shared value, returns 0 if it was there. */
+extern int pm_store_del(const char *key);
+
+/* Allocate memory accounted to owner, NULL for the calling plugin. */
+extern void *pm_malloc(const char *owner, size_t size);
+
+/* Allocate zeroed memory accounted to owner. */
+extern void *pm_calloc(const char *owner, size_t n, size_t size);
+
+/* Resize memory from pm_malloc(), a NULL ptr allocates for owner. */
+extern void *pm_realloc(const char *owner, void *ptr, size_t size);
+
+/* Free memory from pm_malloc(). */
+extern void pm_free(void *ptr);
+
+/* Begin a trace span, returns zero if the request is not traced. */
+extern unsigned long long pm_trace_begin(const SOCKET fd);
+
+/* End a trace span started by pm_trace_begin(). */
+extern void pm_trace_end(const SOCKET fd, const char *name,
+	unsigned long long start);
+
 /* Initialize plugin manager. */
 extern int pm_init(const char *dirname);
 
 /* Clean up plugin manager. */
 extern void pm_deinit(void);
 
+/* Load a single plugin file, returns NULL on failure. */
+extern Plugin *pm_open(const char *path);
+
+/* Add a plugin that runs outside of this process. */
+extern Plugin *pm_attach(const char *name, short unsigned int type,
+	void (*func)(Plugin *self, const SOCKET fd));
+
+/* Set plugins to skip when loading, comma separated or '*' for all. */
+extern void pm_isolate(const char *list);
+
+/* Check if a plugin is on the isolation list. */
+extern int pm_isolated(const char *name);
+
 /* Register help for all external commands. */
 extern void pm_register_help(const SOCKET fd);
 
-/* Register commands for all external command plugins. */
-extern int pm_register_commands(const char *tok, const SOCKET fd);
+/* Call func for every command of the command plugins. */
+extern void pm_commands(void (*func)(const Command *cmd, void *arg),
+	void *arg);
+
+/* Get a counter that changes whenever plugin commands may change. */
+extern unsigned int pm_generation(void);
 
 /* Register all plugins. */
 extern void pm_register(const SOCKET fd);
@@ -58,6 +156,21 @@ extern void pm_set(Plugin *pm, Command *cmds, int CMD_CNT);
 /* Set the type of the plugin. */
 extern void pm_settype(Plugin *pm, short unsigned int type);
 
+/* Set the deadline of a module in milliseconds. */
+extern void pm_settimeout(Plugin *pm, unsigned int ms);
+
+/* Get the deadline of a module in milliseconds. */
+extern unsigned int pm_gettimeout(const Plugin *pm);
+
+/* Get the file name of a plugin. */
+extern const char *pm_getname(const Plugin *pm);
+
+/* Get the type of a plugin. */
+extern short unsigned int pm_gettype(const Plugin *pm);
+
+/* Get the commands of a plugin, returns the count. */
+extern unsigned int pm_getcommands(const Plugin *pm, Command **cmds);
+
 /* Plugin initialization for commands. */
 extern void plugin_init(Plugin *pm);
 
@@ -18,10 +18,12 @@ char _flag;
 
 /* Forward declarations for command functions. */
 CMD_DEF(dummy);
+CMD_DEF(count);
 
 /* Define commands structure. */
 static Command cmds[] = {
-	CMD_ADD1(dummy, "", "Simple example command.")
+	CMD_ADD1(dummy, "", "Simple example command."),
+	CMD_ADD1(count, "", "Count calls, kept across reloads.")
 };
 static int CMD_CNT = sizeof(cmds) / sizeof(cmds[0]);
 
@@ -29,7 +31,31 @@ static int CMD_CNT = sizeof(cmds) / sizeof(cmds[0]);
  */
 CMD_DEF(dummy)
 {
-	printf("I'm a dummy.\n");
+	pm_log(PMLOG_INFO, "I'm a dummy.");
+	return 0;
+}
+
+/* Count calls in the store of the server, survives 'mods reload'. The
+ * reply is built in memory the server accounts to this plugin.
+ */
+CMD_DEF(count)
+{
+	unsigned int count = 0;
+	char *buf;
+	int len;
+
+	if(pm_store_get("plugin1:count", &count, sizeof(count))
+			!= sizeof(count)) {
+		count = 0;
+	}
+	++count;
+	pm_store_set("plugin1:count", &count, sizeof(count), 0);
+	if((buf = (char *)pm_malloc(NULL, 64)) == NULL) {
+		return 1;
+	}
+	len = snprintf(buf, 64, "Count is %u.\r\n", count);
+	pm_send(fd, buf, len);
+	pm_free(buf);
 	return 0;
 }
 
@@ -21,6 +21,6 @@ void init(Plugin *pm, const SOCKET fd)
 		plugin_init(pm);
 	}
 	else {
-		send(fd, "Hello world!\r\n", 14, 0);
+		pm_send(fd, "Hello world!\r\n", 14);
 	}
 }
@@ -0,0 +1,206 @@
+/*
+ * trie.c - Source for a compact command name index.
+ *
+ * Nodes live in one array and link by index, first child and next
+ * sibling, so lookups touch few cache lines and the whole index is freed
+ * at once. Every node counts the commands below it, which resolves an
+ * abbreviation as soon as only one command is left, unless that command
+ * is marked CMD_EXACT.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "trie.h"
+#include "plugin.h"
+
+#define TRIE_GROW 64
+
+/* Add a node, returns its index or zero on error.
+ */
+static unsigned int trie_node(Trie *t, char ch)
+{
+	TrieNode *node;
+
+	if(t->used == t->size) {
+		unsigned int size = t->size + TRIE_GROW;
+		TrieNode *tmp;
+
+		tmp = (TrieNode *)pm_realloc(PMMEM_INDEX, t->nodes,
+			size * sizeof(TrieNode));
+		if(tmp == NULL) {
+			return 0;
+		}
+		t->nodes = tmp;
+		t->size = size;
+	}
+	node = &t->nodes[t->used];
+	memset(node, 0, sizeof(TrieNode));
+	node->ch = ch;
+	return t->used++;
+}
+
+/* Find the child of a node, returns zero if there is none.
+ */
+static unsigned int trie_child(const Trie *t, unsigned int node, char ch)
+{
+	unsigned int i = t->nodes[node].child;
+
+	while(i && t->nodes[i].ch < ch) {
+		i = t->nodes[i].next;
+	}
+	return i && t->nodes[i].ch == ch ? i : 0;
+}
+
+/* Find the node of a prefix, returns zero if there is none.
+ */
+static unsigned int trie_lookup(const Trie *t, const char *prefix)
+{
+	unsigned int node = 0;
+
+	if(t->used == 0) {
+		return 0;
+	}
+	while(*prefix) {
+		if((node = trie_child(t, node, *prefix++)) == 0) {
+			return 0;
+		}
+	}
+	return node;
+}
+
+/* Visit a node and everything below it.
+ */
+static void trie_visit(const Trie *t, unsigned int node,
+	void (*func)(const Command *cmd, void *arg), void *arg)
+{
+	unsigned int i;
+
+	if(t->nodes[node].cmd != NULL) {
+		func(t->nodes[node].cmd, arg);
+	}
+	for(i = t->nodes[node].child; i; i = t->nodes[i].next) {
+		trie_visit(t, i, func, arg);
+	}
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Initialize an empty trie.
+ */
+void trie_init(Trie *t)
+{
+	t->nodes = NULL;
+	t->used = 0;
+	t->size = 0;
+}
+
+/* Free all nodes of a trie.
+ */
+void trie_free(Trie *t)
+{
+	pm_free(t->nodes);
+	trie_init(t);
+}
+
+/* Add a command to the trie.
+ */
+int trie_insert(Trie *t, const Command *cmd)
+{
+	const char *p = cmd->name;
+	unsigned int node = 0;
+
+	if(!*p) {
+		return -1;
+	}
+	if(t->used == 0) {
+		/* Root is node zero, which is also the error value. */
+		(void)trie_node(t, 0);
+		if(t->used == 0) {
+			return -1;
+		}
+	}
+
+	while(*p) {
+		unsigned int prev = 0, i, n;
+
+		for(i = t->nodes[node].child; i && t->nodes[i].ch < *p;
+				i = t->nodes[i].next) {
+			prev = i;
+		}
+		if(i == 0 || t->nodes[i].ch != *p) {
+			if((n = trie_node(t, *p)) == 0) {
+				return -1;
+			}
+			t->nodes[n].next = i;
+			if(prev) {
+				t->nodes[prev].next = n;
+			}
+			else {
+				t->nodes[node].child = n;
+			}
+			i = n;
+		}
+		node = i;
+		++p;
+	}
+	if(t->nodes[node].cmd != NULL) {
+		return 1;
+	}
+	t->nodes[node].cmd = cmd;
+
+	/* Count the new command on its whole path. */
+	node = 0;
+	p = cmd->name;
+	do {
+		t->nodes[node].count++;
+		if(t->nodes[node].first == NULL) {
+			t->nodes[node].first = cmd;
+		}
+	} while(*p && (node = trie_child(t, node, *p++)) != 0);
+	return 0;
+}
+
+/* Resolve a name or unique abbreviation.
+ */
+int trie_find(const Trie *t, const char *name, const Command **cmd)
+{
+	unsigned int node;
+
+	*cmd = NULL;
+	if(!*name || (node = trie_lookup(t, name)) == 0) {
+		return 0;
+	}
+	if(t->nodes[node].cmd != NULL) {
+		*cmd = t->nodes[node].cmd;
+		return 1;
+	}
+	if(t->nodes[node].count == 1) {
+		if(t->nodes[node].first->flags & CMD_EXACT) {
+			return 0;
+		}
+		*cmd = t->nodes[node].first;
+	}
+	return t->nodes[node].count;
+}
+
+/* Call func for every command starting with prefix.
+ */
+int trie_walk(const Trie *t, const char *prefix,
+	void (*func)(const Command *cmd, void *arg), void *arg)
+{
+	unsigned int node;
+
+	if(t->used == 0) {
+		return 0;
+	}
+	if((node = trie_lookup(t, prefix)) == 0 && *prefix) {
+		return 0;
+	}
+	trie_visit(t, node, func, arg);
+	return t->nodes[node].count;
+}
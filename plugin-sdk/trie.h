@@ -0,0 +1,51 @@
+/*
+ * trie.h - Header for a compact command name index.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _TRIE_H_
+#define _TRIE_H_
+
+#include "cmd.h"
+
+/* Trie node definition and typedef, children are kept sorted. */
+struct TrieNode {
+	const Command *cmd;
+	const Command *first;
+	unsigned int child;
+	unsigned int next;
+	unsigned int count;
+	char ch;
+};
+typedef struct TrieNode TrieNode;
+
+/* Trie definition and typedef, node zero is the root. */
+struct Trie {
+	TrieNode *nodes;
+	unsigned int used;
+	unsigned int size;
+};
+typedef struct Trie Trie;
+
+/* Initialize an empty trie. */
+extern void trie_init(Trie *t);
+
+/* Free all nodes of a trie. */
+extern void trie_free(Trie *t);
+
+/* Add a command, returns 1 if the name is taken or -1 on error. */
+extern int trie_insert(Trie *t, const Command *cmd);
+
+/* Resolve a name or unique abbreviation, returns number of matches.
+ * Commands marked CMD_EXACT only match their full name. */
+extern int trie_find(const Trie *t, const char *name, const Command **cmd);
+
+/* Call func for every command starting with prefix in sorted order. */
+extern int trie_walk(const Trie *t, const char *prefix,
+	void (*func)(const Command *cmd, void *arg), void *arg);
+
+#endif
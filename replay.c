@@ -0,0 +1,528 @@
+/*
+ * replay.c - Source for replaying captured sessions against netcom.
+ *
+ * Sessions from a capture file are replayed at their original pace, a
+ * scaled pace, or as fast as the server answers. Every session gets its
+ * own connection; latency is measured from sending a command to the
+ * next prompt. The 'exit' command is never replayed. Commands and
+ * connections the server turned away for its limits are counted apart
+ * and left out of the latencies.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+
+#include <time.h>
+
+#include "prs/network.h"
+#include "capture.h"
+
+/* Longest time to wait for outstanding responses of a session (ms). */
+#define REPLAY_DRAIN 5000
+/* Commands that may wait for a response per session. */
+#define REPLAY_INFLIGHT 256
+/* Bytes kept from the start of each response to spot rejections. */
+#define REPLAY_HEAD 32
+
+/* Answers of the server when its limits turn a client away. */
+#define REPLAY_BUSY "Busy, try again later.\r\n"
+#define REPLAY_REFUSED "Server busy, try again later.\r\n"
+
+/* Replay event definition and typedef. */
+struct Event {
+	int type;
+	unsigned long long time;
+	unsigned int len;
+	char *data;
+	struct Event *next;
+};
+typedef struct Event Event;
+
+/* Replay connection definition and typedef. */
+struct Conn {
+	unsigned int id;
+	SOCKET fd;
+	int done;
+	int matched;
+	int greeting;
+	unsigned int pending;
+	unsigned long long drain;
+	unsigned long long sent[REPLAY_INFLIGHT];
+	unsigned char start[REPLAY_HEAD];
+	unsigned int startlen;
+	Event *head;
+	Event *tail;
+};
+typedef struct Conn Conn;
+
+static const unsigned char prompt[4] = { '>', '>', ' ', 0 };
+
+static Conn *conns;
+static unsigned int conn_count;
+static unsigned long long *latency;
+static unsigned long lat_count, lat_size;
+static unsigned long commands, skipped, received;
+static unsigned long rejected, refused;
+
+/* Get microseconds from a monotonic clock.
+ */
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL
+		+ ts.tv_nsec / 1000;
+}
+
+/* Read an unsigned LEB128 integer.
+ */
+static int read_varint(FILE *fp, unsigned long long *v)
+{
+	int shift = 0;
+	int c;
+
+	*v = 0;
+	do {
+		if((c = fgetc(fp)) == EOF || shift > 63) {
+			return -1;
+		}
+		*v |= (unsigned long long)(c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+	return 0;
+}
+
+/* Find connection of a captured session, creating it if needed.
+ */
+static Conn *conn_get(unsigned int id)
+{
+	unsigned int i;
+	Conn *tmp;
+
+	for(i = 0; i < conn_count; i++) {
+		if(conns[i].id == id) {
+			return &conns[i];
+		}
+	}
+	tmp = (Conn *)realloc(conns, sizeof(Conn) * (conn_count + 1));
+	if(tmp == NULL) {
+		return NULL;
+	}
+	conns = tmp;
+	memset(&conns[conn_count], 0, sizeof(Conn));
+	conns[conn_count].id = id;
+	conns[conn_count].fd = INVALID_SOCKET;
+	return &conns[conn_count++];
+}
+
+/* Load a capture file into per session event lists.
+ */
+static int load(const char *path)
+{
+	unsigned long long now = 0, v, id;
+	unsigned char hdr[14];
+	FILE *fp;
+	int type;
+
+	if((fp = fopen(path, "rb")) == NULL) {
+		fprintf(stderr, "Error: Cannot open %s.\n", path);
+		return -1;
+	}
+	if(fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)
+			|| memcmp(hdr, CAPTURE_MAGIC, 4)
+			|| hdr[4] != CAPTURE_VERSION) {
+		fprintf(stderr, "Error: %s is not a capture file.\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	while((type = fgetc(fp)) != EOF) {
+		Event *ev;
+		Conn *c;
+
+		if(read_varint(fp, &v) < 0 || read_varint(fp, &id) < 0) {
+			break;
+		}
+		now += v;
+		if((c = conn_get((unsigned int)id)) == NULL) {
+			break;
+		}
+		if((ev = (Event *)calloc(1, sizeof(Event))) == NULL) {
+			break;
+		}
+		ev->type = type;
+		ev->time = now;
+
+		if(type == CAPTURE_COMMAND) {
+			if(read_varint(fp, &v) < 0
+					|| (ev->data = (char *)malloc(v + 1)) == NULL
+					|| fread(ev->data, 1, v, fp) != v) {
+				free(ev);
+				break;
+			}
+			ev->len = (unsigned int)v;
+			ev->data[v] = 0;
+			if(!strncmp(ev->data, "exit", 4)
+					&& strchr(" \r\n", ev->data[4]) != NULL) {
+				free(ev->data);
+				free(ev);
+				++skipped;
+				continue;
+			}
+		}
+		else if(type == CAPTURE_RESPONSE) {
+			read_varint(fp, &v);
+			read_varint(fp, &v);
+			free(ev);
+			continue;
+		}
+		else if(type != CAPTURE_OPEN && type != CAPTURE_CLOSE) {
+			free(ev);
+			break;
+		}
+
+		if(c->tail != NULL) {
+			c->tail->next = ev;
+		}
+		else {
+			c->head = ev;
+		}
+		c->tail = ev;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* Connect to the server.
+ */
+static SOCKET dial(const char *host, const char *port)
+{
+	struct addrinfo hints, *res, *ai;
+	SOCKET fd = INVALID_SOCKET;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(host, port, &hints, &res) != 0) {
+		return INVALID_SOCKET;
+	}
+	for(ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(fd == INVALID_SOCKET) {
+			continue;
+		}
+		if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		socket_close(fd);
+		fd = INVALID_SOCKET;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/* Remember latency of a response.
+ */
+static void record(unsigned long long us)
+{
+	if(lat_count == lat_size) {
+		unsigned long size = lat_size ? lat_size * 2 : 1024;
+		unsigned long long *tmp = (unsigned long long *)realloc(latency,
+			sizeof(unsigned long long) * size);
+		if(tmp == NULL) {
+			return;
+		}
+		latency = tmp;
+		lat_size = size;
+	}
+	latency[lat_count++] = us;
+}
+
+/* Check if the response so far starts with msg, raw or in a frame.
+ */
+static int conn_starts(const Conn *c, const char *msg)
+{
+	const unsigned int len = strlen(msg);
+
+	if(c->startlen >= len && !memcmp(c->start, msg, len)) {
+		return 1;
+	}
+	return c->startlen >= len + 5 && c->start[0] == 'R'
+		&& !memcmp(c->start + 5, msg, len);
+}
+
+/* Read responses of a connection, matching prompts to commands.
+ */
+static int conn_read(Conn *c)
+{
+	unsigned char buf[4096];
+	int nbytes, i;
+
+	nbytes = recv(c->fd, (char *)buf, sizeof(buf), 0);
+	if(nbytes <= 0) {
+		if(c->greeting && conn_starts(c, REPLAY_REFUSED)) {
+			++refused;
+		}
+		return -1;
+	}
+	received += nbytes;
+	for(i = 0; i < nbytes; i++) {
+		if(c->startlen < REPLAY_HEAD) {
+			c->start[c->startlen++] = buf[i];
+		}
+		if(buf[i] == prompt[c->matched]) {
+			if(++c->matched < (int)sizeof(prompt)) {
+				continue;
+			}
+			c->matched = 0;
+			if(c->pending > 0) {
+				/* Oldest command is at the end. */
+				--c->pending;
+				if(c->greeting) {
+					c->greeting = 0;
+				}
+				else if(conn_starts(c, REPLAY_BUSY)) {
+					++rejected;
+				}
+				else {
+					record(now_us() - c->sent[c->pending]);
+				}
+			}
+			c->startlen = 0;
+		}
+		else {
+			c->matched = buf[i] == prompt[0] ? 1 : 0;
+		}
+	}
+	return 0;
+}
+
+/* Close a connection and drop its remaining events.
+ */
+static void conn_close(Conn *c)
+{
+	while(c->head != NULL) {
+		Event *next = c->head->next;
+		free(c->head->data);
+		free(c->head);
+		c->head = next;
+	}
+	if(c->fd != INVALID_SOCKET) {
+		socket_close(c->fd);
+		c->fd = INVALID_SOCKET;
+	}
+	c->done = 1;
+}
+
+/* Compare two latencies for sorting.
+ */
+static int cmp_latency(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Print replay results as key value pairs.
+ */
+static void report(unsigned long long elapsed)
+{
+	unsigned long long sum = 0;
+	unsigned long i;
+
+	qsort(latency, lat_count, sizeof(unsigned long long), cmp_latency);
+	for(i = 0; i < lat_count; i++) {
+		sum += latency[i];
+	}
+	printf("sessions=%u\n", conn_count);
+	printf("commands=%lu\n", commands);
+	printf("skipped=%lu\n", skipped);
+	printf("responses=%lu\n", lat_count);
+	printf("rejected=%lu\n", rejected);
+	printf("refused=%lu\n", refused);
+	printf("bytes_received=%lu\n", received);
+	printf("elapsed_ms=%llu\n", elapsed);
+	if(lat_count > 0) {
+		printf("latency_avg_us=%llu\n", sum / lat_count);
+		printf("latency_p50_us=%llu\n", latency[lat_count / 2]);
+		printf("latency_p99_us=%llu\n",
+			latency[(lat_count * 99) / 100]);
+		printf("latency_max_us=%llu\n", latency[lat_count - 1]);
+	}
+}
+
+/* Show how to use this program.
+ */
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-h host] [-p port] [-s scale | -m] "
+		"capture-file\n"
+		"  -s scale  replay scale times faster than captured\n"
+		"  -m        replay as fast as the server answers\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *host = "127.0.0.1";
+	const char *port = "48879";
+	unsigned long long start, now;
+	struct pollfd *fds;
+	double scale = 1.0;
+	int maxspeed = 0;
+	unsigned int i;
+	int opt;
+
+	while((opt = getopt(argc, argv, "h:p:s:m")) != -1) {
+		switch(opt) {
+			case 'h':
+				host = optarg;
+			break;
+			case 'p':
+				port = optarg;
+			break;
+			case 's':
+				scale = atof(optarg);
+			break;
+			case 'm':
+				maxspeed = 1;
+			break;
+			default:
+				usage(argv[0]);
+				return 1;
+			break;
+		}
+	}
+	if(optind >= argc || scale <= 0.0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if(load(argv[optind]) < 0) {
+		return 1;
+	}
+	if((fds = (struct pollfd *)calloc(conn_count + 1,
+			sizeof(struct pollfd))) == NULL) {
+		return 1;
+	}
+
+	start = now_us() / 1000;
+	for(;;) {
+		unsigned int active = 0, total = 0;
+		long wait = 100;
+
+		now = now_us() / 1000;
+		for(i = 0; i < conn_count; i++) {
+			Conn *c = &conns[i];
+			Event *ev = c->head;
+
+			if(c->done) {
+				continue;
+			}
+			++active;
+
+			/* Run every event that is due. */
+			while(ev != NULL) {
+				unsigned long long due = start
+					+ (unsigned long long)(ev->time / scale);
+
+				if(maxspeed ? (c->fd != INVALID_SOCKET
+						&& c->pending > 0) : due > now) {
+					if(!maxspeed && (long)(due - now) < wait) {
+						wait = (long)(due - now);
+					}
+					break;
+				}
+				if(ev->type == CAPTURE_CLOSE) {
+					if(c->pending > 0 && c->fd != INVALID_SOCKET) {
+						if(!c->drain) {
+							c->drain = now + REPLAY_DRAIN;
+						}
+						if(now < c->drain) {
+							break;
+						}
+					}
+					conn_close(c);
+					ev = NULL;
+					break;
+				}
+				if(c->fd == INVALID_SOCKET) {
+					c->fd = dial(host, port);
+					if(c->fd == INVALID_SOCKET) {
+						fprintf(stderr, "Error: Cannot connect "
+							"to %s:%s.\n", host, port);
+						conn_close(c);
+						ev = NULL;
+						break;
+					}
+					c->pending = 1;
+					c->greeting = 1;
+					c->sent[0] = now_us();
+				}
+				if(ev->type == CAPTURE_COMMAND) {
+					if(c->pending < REPLAY_INFLIGHT) {
+						memmove(&c->sent[1], &c->sent[0],
+							sizeof(c->sent[0]) * c->pending);
+						c->sent[0] = now_us();
+						send(c->fd, ev->data, ev->len, 0);
+						c->pending++;
+						commands++;
+					}
+				}
+				c->head = ev->next;
+				free(ev->data);
+				free(ev);
+				ev = c->head;
+			}
+			if(ev == NULL && !c->done && c->pending == 0) {
+				conn_close(c);
+			}
+			if(!c->done && c->fd != INVALID_SOCKET) {
+				fds[total].fd = c->fd;
+				fds[total].events = POLLIN;
+				fds[total].revents = 0;
+				++total;
+			}
+		}
+		if(!active) {
+			break;
+		}
+
+		if(poll(fds, total, wait < 0 ? 0 : wait) > 0) {
+			for(i = 0; i < conn_count; i++) {
+				Conn *c = &conns[i];
+				unsigned int j;
+
+				if(c->done || c->fd == INVALID_SOCKET) {
+					continue;
+				}
+				for(j = 0; j < total; j++) {
+					if(fds[j].fd == c->fd && fds[j].revents) {
+						if(conn_read(c) < 0) {
+							conn_close(c);
+						}
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	report(now_us() / 1000 - start);
+	free(fds);
+	free(conns);
+	free(latency);
+	return 0;
+}
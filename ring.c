@@ -0,0 +1,177 @@
+/*
+ * ring.c - Source for shared memory message rings.
+ *
+ * Each ring has one writer and one reader, and messages are always
+ * contiguous so the reader can use a payload in place. A writer that
+ * does not fit before the end of the ring pads it and starts over at the
+ * beginning. Both sides spin for a short while before sleeping on an
+ * eventfd, and only write the eventfd when the other side sleeps.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux)
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#endif
+
+#include "ring.h"
+
+#define RING_MASK (RING_SIZE-1)
+#define RING_ALIGN(x) (((x) + 15) & ~15U)
+
+/* Get nanoseconds from a monotonic clock.
+ */
+unsigned long long ring_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Reserve room for a payload.
+ */
+void *ring_reserve(Ring *r, unsigned int len)
+{
+	unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	unsigned int need = RING_ALIGN(sizeof(RingMsg) + len);
+	unsigned int room = RING_SIZE - (head & RING_MASK);
+
+	if(len > RING_MSGMAX) {
+		return NULL;
+	}
+	/* Pad up to the end if the message does not fit there. */
+	if(room < need) {
+		RingMsg *pad;
+
+		if(RING_SIZE - (head - tail) < room + need) {
+			return NULL;
+		}
+		pad = (RingMsg *)&r->data[head & RING_MASK];
+		pad->type = RING_PAD;
+		pad->len = room - sizeof(RingMsg);
+		atomic_store_explicit(&r->head, head + room, memory_order_release);
+		head += room;
+	}
+	else if(RING_SIZE - (head - tail) < need) {
+		return NULL;
+	}
+	return &r->data[(head & RING_MASK) + sizeof(RingMsg)];
+}
+
+/* Publish the message reserved last.
+ */
+void ring_commit(Ring *r, unsigned int type, unsigned int seq,
+	int fd, unsigned int len)
+{
+	unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	RingMsg *msg = (RingMsg *)&r->data[head & RING_MASK];
+
+	msg->type = type;
+	msg->len = len;
+	msg->seq = seq;
+	msg->fd = fd;
+	atomic_store_explicit(&r->head, head + RING_ALIGN(sizeof(RingMsg) + len),
+		memory_order_seq_cst);
+}
+
+/* Get the oldest message without removing it.
+ */
+RingMsg *ring_peek(Ring *r)
+{
+	unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+	RingMsg *msg;
+
+	while(tail != head) {
+		msg = (RingMsg *)&r->data[tail & RING_MASK];
+		if(msg->type != RING_PAD) {
+			return msg;
+		}
+		tail += RING_ALIGN(sizeof(RingMsg) + msg->len);
+		atomic_store_explicit(&r->tail, tail, memory_order_release);
+	}
+	return NULL;
+}
+
+/* Remove the message returned by ring_peek().
+ */
+void ring_release(Ring *r, RingMsg *msg)
+{
+	unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&r->tail, tail + RING_ALIGN(sizeof(RingMsg)
+		+ msg->len), memory_order_seq_cst);
+}
+
+/* Wake the other side if it sleeps.
+ */
+void ring_wake(atomic_int *sleeping, int efd)
+{
+#if defined(__linux)
+	unsigned long long one = 1;
+
+	if(atomic_load(sleeping)) {
+		(void)!write(efd, &one, sizeof(one));
+	}
+#endif
+}
+
+/* Wait until ready() returns non zero.
+ */
+int ring_wait(atomic_int *sleeping, int efd, int alive,
+	int (*ready)(void *arg), void *arg, int timeout)
+{
+#if defined(__linux)
+	unsigned long long start = ring_now();
+	struct pollfd pfd[2];
+	unsigned long long count;
+	int rc;
+
+	/* Yield while spinning so the other side can run on one CPU. */
+	do {
+		if(ready(arg)) {
+			return 1;
+		}
+		sched_yield();
+	} while(ring_now() - start < RING_SPIN);
+
+	pfd[0].fd = efd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = alive;
+	pfd[1].events = POLLIN;
+	atomic_store(sleeping, 1);
+	if(ready(arg)) {
+		atomic_store(sleeping, 0);
+		return 1;
+	}
+	pfd[0].revents = pfd[1].revents = 0;
+	rc = poll(pfd, 2, timeout);
+	atomic_store(sleeping, 0);
+	if(rc > 0 && (pfd[0].revents & POLLIN)) {
+		(void)!read(efd, &count, sizeof(count));
+	}
+	if(ready(arg)) {
+		return 1;
+	}
+	if(rc > 0 && (pfd[1].revents & (POLLIN|POLLHUP|POLLERR))) {
+		return -1;
+	}
+	return 0;
+#else
+	return ready(arg) ? 1 : -1;
+#endif
+}
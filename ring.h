@@ -0,0 +1,87 @@
+/*
+ * ring.h - Header for shared memory message rings.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stdatomic.h>
+
+/* Bytes of data in each ring, a power of two. */
+#define RING_SIZE (256*1024)
+/* Largest payload of one message. */
+#define RING_MSGMAX (RING_SIZE/4)
+/* Spin this long before sleeping on the eventfd (ns). */
+#define RING_SPIN 50000
+
+/* Message types, requests go to the host and the rest come back. */
+enum {
+	RING_PAD,
+	RING_HELLO,
+	RING_CALL,
+	RING_EXEC,
+	RING_SEND,
+	RING_LOG,
+	RING_DONE,
+	RING_STORE,
+	RING_REPLY
+};
+
+/* Store operations a host forwards to the server. */
+enum { RING_STORE_GET, RING_STORE_SET, RING_STORE_DEL };
+
+/* Message header definition and typedef, payload follows it. */
+struct RingMsg {
+	unsigned int type;
+	unsigned int len;
+	unsigned int seq;
+	int fd;
+};
+typedef struct RingMsg RingMsg;
+
+/* Single producer, single consumer ring definition and typedef. */
+struct Ring {
+	atomic_uint head;
+	atomic_uint tail;
+	char data[RING_SIZE];
+};
+typedef struct Ring Ring;
+
+/* Memory shared between the server and a host definition and typedef. */
+struct RingShared {
+	atomic_int server_sleeping;
+	atomic_int host_sleeping;
+	Ring request;
+	Ring response;
+};
+typedef struct RingShared RingShared;
+
+/* Get nanoseconds from a monotonic clock. */
+extern unsigned long long ring_now(void);
+
+/* Reserve room for a payload, returns NULL if the ring is full. */
+extern void *ring_reserve(Ring *r, unsigned int len);
+
+/* Publish the message reserved last. */
+extern void ring_commit(Ring *r, unsigned int type, unsigned int seq,
+	int fd, unsigned int len);
+
+/* Get the oldest message without removing it, NULL if empty. */
+extern RingMsg *ring_peek(Ring *r);
+
+/* Remove the message returned by ring_peek(). */
+extern void ring_release(Ring *r, RingMsg *msg);
+
+/* Wake the other side if it sleeps. */
+extern void ring_wake(atomic_int *sleeping, int efd);
+
+/* Wait until ready() or timeout, returns 1 ready, 0 timeout, -1 gone. */
+extern int ring_wait(atomic_int *sleeping, int efd, int alive,
+	int (*ready)(void *arg), void *arg, int timeout);
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * session.c - Source for client session tracking.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "session.h"
+#include "output.h"
+#include "log.h"
+#include "mem.h"
+
+/* Open addressing table, kept at most half full. */
+#define TABLE_SIZE (SESSION_MAX*2)
+#define TABLE_MASK (TABLE_SIZE-1)
+
+static Session *table[TABLE_SIZE];
+static unsigned int next_id;
+static int total;
+
+/* Hash a socket into a table slot.
+ */
+static unsigned int session_hash(const SOCKET fd)
+{
+	return ((unsigned long)fd * 2654435761UL) & TABLE_MASK;
+}
+
+/* Create a session for a newly accepted client.
+ */
+Session *session_open(const SOCKET fd, const char *addr)
+{
+	Session *s;
+	unsigned int i;
+
+	if(total >= SESSION_MAX || session_get(fd) != NULL) {
+		return NULL;
+	}
+
+	s = (Session *)mem_calloc(MEM_SESSIONS, 1, sizeof(Session));
+	if(s == NULL) {
+		return NULL;
+	}
+	s->fd = fd;
+	s->id = ++next_id;
+	snprintf(s->addr, sizeof(s->addr), "%s", addr != NULL ? addr : "");
+
+	/* Every session starts where the server was started. */
+	if(getcwd(s->cwd, sizeof(s->cwd)) == NULL) {
+		snprintf(s->cwd, sizeof(s->cwd), ".");
+	}
+
+	i = session_hash(fd);
+	while(table[i] != NULL) {
+		i = (i + 1) & TABLE_MASK;
+	}
+	table[i] = s;
+	++total;
+	return s;
+}
+
+/* Destroy the session of a client.
+ */
+void session_close(const SOCKET fd)
+{
+	unsigned int i, j;
+
+	i = session_hash(fd);
+	while(table[i] != NULL && table[i]->fd != fd) {
+		i = (i + 1) & TABLE_MASK;
+	}
+	if(table[i] == NULL) {
+		return;
+	}
+
+	timer_cancel(&table[i]->idle);
+	out_free(table[i]);
+	mem_free(table[i]->wbuf);
+	mem_free(table[i]);
+	table[i] = NULL;
+	--total;
+
+	/* Shift back following entries so lookups never stop early. */
+	j = i;
+	for(;;) {
+		unsigned int home;
+
+		j = (j + 1) & TABLE_MASK;
+		if(table[j] == NULL) {
+			break;
+		}
+		home = session_hash(table[j]->fd);
+		if(((j - home) & TABLE_MASK) >= ((j - i) & TABLE_MASK)) {
+			table[i] = table[j];
+			table[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+/* Find the session of a client.
+ */
+Session *session_get(const SOCKET fd)
+{
+	unsigned int i;
+
+	i = session_hash(fd);
+	while(table[i] != NULL) {
+		if(table[i]->fd == fd) {
+			return table[i];
+		}
+		i = (i + 1) & TABLE_MASK;
+	}
+	return NULL;
+}
+
+/* Get number of open sessions.
+ */
+int session_count(void)
+{
+	return total;
+}
+
+/* Iterate over sessions, start with pos at zero.
+ */
+Session *session_next(unsigned int *pos)
+{
+	while(*pos < TABLE_SIZE) {
+		Session *s = table[(*pos)++];
+		if(s != NULL) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+/* Set deadline of the running command, zero clears it.
+ */
+void session_deadline(const SOCKET fd, unsigned int ms)
+{
+	Session *s = session_get(fd);
+
+	if(s != NULL) {
+		s->deadline = ms ? timer_clock() + ms : 0;
+	}
+}
+
+/* Check if the running command is past its deadline.
+ */
+int session_cancelled(const SOCKET fd)
+{
+	Session *s = session_get(fd);
+
+	return s != NULL && s->deadline && timer_clock() >= s->deadline;
+}
+
+/* Make a client socket non-blocking.
+ */
+int session_nonblock(const SOCKET fd)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	u_long on = 1;
+
+	return ioctlsocket(fd, FIONBIO, &on) == 0 ? 0 : -1;
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+
+	if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+/* Check if the last socket call failed only because it would block.
+ */
+int session_blocked(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+/* Give up on a client, what it has not read yet is dropped.
+ */
+static int session_fail(Session *s)
+{
+	mem_free(s->wbuf);
+	s->wbuf = NULL;
+	s->wpos = s->wlen = s->wsize = 0;
+	s->dropped = 1;
+	s->quit = 1;
+	return -1;
+}
+
+/* Add bytes to the output queue of a client.
+ */
+static int session_queue(Session *s, const unsigned char *buf,
+	unsigned int len)
+{
+	unsigned int size = s->wsize ? s->wsize : 4096;
+	unsigned char *tmp;
+	Session *prev;
+
+	if(s->wlen - s->wpos + len > SESSION_QUEUE) {
+		return -1;
+	}
+	if(s->wpos > 0) {
+		memmove(s->wbuf, s->wbuf + s->wpos, s->wlen - s->wpos);
+		s->wlen -= s->wpos;
+		s->wpos = 0;
+	}
+	while(size < s->wlen + len) {
+		size *= 2;
+	}
+	if(size != s->wsize) {
+		prev = mem_charge(s);
+		tmp = (unsigned char *)mem_realloc(MEM_IO, s->wbuf, size);
+		mem_charge(prev);
+		if(tmp == NULL) {
+			return -1;
+		}
+		s->wbuf = tmp;
+		s->wsize = size;
+	}
+	memcpy(s->wbuf + s->wlen, buf, len);
+	s->wlen += len;
+	return 0;
+}
+
+/* Send bytes to a client, queueing what the socket does not take now.
+ */
+int session_write(Session *s, const void *buf, unsigned int len)
+{
+	const unsigned char *data = (const unsigned char *)buf;
+	unsigned int done = 0;
+
+	if(s->dropped) {
+		return -1;
+	}
+
+	/* Nothing may overtake output that is already waiting. */
+	while(s->wpos == s->wlen && done < len) {
+		int rc = send(s->fd, (const char *)data + done, len - done, 0);
+		if(rc < 0 && session_blocked()) {
+			break;
+		}
+		if(rc <= 0) {
+			return session_fail(s);
+		}
+		done += rc;
+	}
+	if(done < len && session_queue(s, data + done, len - done) < 0) {
+		log_write(PMLOG_WARN, "Client %s fell behind, closed.", s->addr);
+		return session_fail(s);
+	}
+	return len;
+}
+
+/* Send queued output of a client.
+ */
+int session_flush(Session *s)
+{
+	while(s->wpos < s->wlen) {
+		int rc = send(s->fd, (const char *)s->wbuf + s->wpos,
+			s->wlen - s->wpos, 0);
+		if(rc < 0 && session_blocked()) {
+			return 0;
+		}
+		if(rc <= 0) {
+			return session_fail(s);
+		}
+		s->wpos += rc;
+	}
+
+	/* Drained, so an idle session holds no buffer. */
+	mem_free(s->wbuf);
+	s->wbuf = NULL;
+	s->wpos = s->wlen = s->wsize = 0;
+	return 0;
+}
+
+/* Change working directory of a session.
+ */
+int session_chdir(Session *s, const char *path)
+{
+	char buf[SESSION_PATH*2];
+	struct stat st;
+	char *full;
+	int rc = -1;
+
+	if(s == NULL || path == NULL || !*path) {
+		return -1;
+	}
+#if defined(_WIN32) || defined(_WIN64)
+	if(path[0] == '/' || path[0] == '\\' || path[1] == ':') {
+#else
+	if(path[0] == '/') {
+#endif
+		snprintf(buf, sizeof(buf), "%s", path);
+	}
+	else {
+		snprintf(buf, sizeof(buf), "%s/%s", s->cwd, path);
+	}
+
+#if defined(_WIN32) || defined(_WIN64)
+	full = _fullpath(NULL, buf, 0);
+#else
+	full = realpath(buf, NULL);
+#endif
+	if(full != NULL && strlen(full) < sizeof(s->cwd)
+			&& stat(full, &st) == 0 && S_ISDIR(st.st_mode)) {
+		snprintf(s->cwd, sizeof(s->cwd), "%s", full);
+		rc = 0;
+	}
+	free(full);
+	return rc;
+}
@@ -0,0 +1,98 @@
+/*
+ * session.h - Header for client session tracking.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _SESSION_H_
+#define _SESSION_H_
+
+#include "prs/network.h"
+#include "timer.h"
+
+#define SESSION_MAX 4096
+/* Longest command line a client may send. */
+#define SESSION_LINE 256
+/* Idle sessions are closed after this many milliseconds. */
+#define SESSION_IDLE 300000
+/* Longest working directory of a session. */
+#define SESSION_PATH 1024
+/* Most output a client may leave unread before it is disconnected. */
+#define SESSION_QUEUE (1024*1024)
+
+/* Output stream, limit entry and channel forward declarations. */
+struct OutStream;
+struct LimitEntry;
+struct Channel;
+struct ChannelMux;
+
+/* Session definition and typedef. */
+struct Session {
+	SOCKET fd;
+	unsigned int id;
+	char addr[INET6_ADDRSTRLEN+1];
+	struct OutStream *out;
+	int trace;
+	struct LimitEntry *limit;
+	struct Channel *chan;
+	struct ChannelMux *mux;
+	Timer idle;
+	unsigned long long deadline;
+	unsigned long sent;
+	unsigned long mem;
+	unsigned long mem_peak;
+	unsigned long mem_failed;
+	int quit;
+	int dropped;
+	unsigned char *wbuf;
+	unsigned int wpos;
+	unsigned int wlen;
+	unsigned int wsize;
+	unsigned int used;
+	char line[SESSION_LINE];
+	char cwd[SESSION_PATH];
+};
+typedef struct Session Session;
+
+/* Create a session for a newly accepted client. */
+extern Session *session_open(const SOCKET fd, const char *addr);
+
+/* Destroy the session of a client. */
+extern void session_close(const SOCKET fd);
+
+/* Find the session of a client. */
+extern Session *session_get(const SOCKET fd);
+
+/* Get number of open sessions. */
+extern int session_count(void);
+
+/* Iterate over sessions, start with pos at zero. */
+extern Session *session_next(unsigned int *pos);
+
+/* Set deadline of the running command, zero clears it. */
+extern void session_deadline(const SOCKET fd, unsigned int ms);
+
+/* Check if the running command is past its deadline. */
+extern int session_cancelled(const SOCKET fd);
+
+/* Make a client socket non-blocking. */
+extern int session_nonblock(const SOCKET fd);
+
+/* Check if the last socket call failed only because it would block. */
+extern int session_blocked(void);
+
+/* Send bytes to a client, queueing what the socket does not take now.
+ * Returns -1 and marks the session dropped if it cannot be sent. */
+extern int session_write(Session *s, const void *buf, unsigned int len);
+
+/* Send queued output of a client, returns -1 on error. */
+extern int session_flush(Session *s);
+
+/* Change working directory of a session, path is relative to the one it
+ * has now. Returns -1 if path is not a directory. */
+extern int session_chdir(Session *s, const char *path);
+
+#endif
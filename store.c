@@ -0,0 +1,311 @@
+/*
+ * store.c - Source for the key value store shared by plugins.
+ *
+ * The store belongs to the server, so values survive 'mods reload' and
+ * plugins can share them. Entries are never changed once linked: a
+ * writer builds a new entry and swaps it into its chain under a mutex,
+ * readers walk the chains without locking. Replaced entries are retired
+ * and only freed once no reader is inside the store.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "store.h"
+#include "timer.h"
+
+#define STORE_MASK (STORE_BUCKETS-1)
+
+/* Store entry definition and typedef, key and value follow it. */
+struct StoreEntry {
+	_Atomic(struct StoreEntry *) next;
+	struct StoreEntry *retired;
+	unsigned long long expires;
+	unsigned int hash;
+	unsigned int klen;
+	unsigned int vlen;
+	char data[];
+};
+typedef struct StoreEntry StoreEntry;
+
+static _Atomic(StoreEntry *) buckets[STORE_BUCKETS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static StoreEntry *retired;
+static atomic_int readers;
+static unsigned long limit = STORE_LIMIT;
+static unsigned long keys;
+static unsigned long bytes;
+static unsigned long expired;
+static unsigned long rejected;
+static atomic_ulong hits;
+static atomic_ulong misses;
+
+/* Hash a key.
+ */
+static unsigned int store_hash(const char *key, unsigned int len)
+{
+	unsigned int h = 2166136261U;
+
+	while(len--) {
+		h = (h ^ (unsigned char)*key++) * 16777619U;
+	}
+	return h;
+}
+
+/* Memory an entry accounts for.
+ */
+static unsigned long store_size(const StoreEntry *e)
+{
+	return sizeof(StoreEntry) + e->klen + e->vlen;
+}
+
+/* Check if an entry has expired.
+ */
+static int store_expired(const StoreEntry *e, unsigned long long now)
+{
+	return e->expires && now >= e->expires;
+}
+
+/* Retire an unlinked entry, the lock must be held.
+ */
+static void store_retire(StoreEntry *e)
+{
+	keys--;
+	bytes -= store_size(e);
+	e->retired = retired;
+	retired = e;
+}
+
+/* Free retired entries if no reader can still see them, lock held.
+ */
+static void store_reclaim(void)
+{
+	if(atomic_load(&readers) != 0) {
+		return;
+	}
+	while(retired != NULL) {
+		StoreEntry *e = retired;
+
+		retired = e->retired;
+		free(e);
+	}
+}
+
+/* Find the link pointing at a key, the lock must be held.
+ */
+static _Atomic(StoreEntry *) *store_link(const char *key, unsigned int klen,
+	unsigned int hash)
+{
+	_Atomic(StoreEntry *) *link = &buckets[hash & STORE_MASK];
+	StoreEntry *e;
+
+	while((e = atomic_load(link)) != NULL) {
+		if(e->hash == hash && e->klen == klen
+				&& !memcmp(e->data, key, klen)) {
+			break;
+		}
+		link = &e->next;
+	}
+	return link;
+}
+
+/* Unlink expired entries, the lock must be held.
+ */
+static void store_purge(unsigned long long now)
+{
+	unsigned int i;
+
+	for(i = 0; i < STORE_BUCKETS; i++) {
+		_Atomic(StoreEntry *) *link = &buckets[i];
+		StoreEntry *e;
+
+		while((e = atomic_load(link)) != NULL) {
+			if(store_expired(e, now)) {
+				atomic_store(link, atomic_load(&e->next));
+				store_retire(e);
+				expired++;
+			}
+			else {
+				link = &e->next;
+			}
+		}
+	}
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Get a value, copies at most len bytes into buf.
+ */
+int store_get(const char *key, void *buf, int len)
+{
+	unsigned int klen = strlen(key);
+	unsigned int hash = store_hash(key, klen);
+	unsigned long long now = timer_clock();
+	int rc = -1;
+	StoreEntry *e;
+
+	atomic_fetch_add(&readers, 1);
+	for(e = atomic_load(&buckets[hash & STORE_MASK]); e != NULL;
+			e = atomic_load(&e->next)) {
+		if(e->hash == hash && e->klen == klen
+				&& !memcmp(e->data, key, klen)) {
+			if(!store_expired(e, now)) {
+				if(buf != NULL && len > 0) {
+					memcpy(buf, e->data + klen, (unsigned int)len < e->vlen
+						? (unsigned int)len : e->vlen);
+				}
+				rc = e->vlen;
+			}
+			break;
+		}
+	}
+	atomic_fetch_sub(&readers, 1);
+	atomic_fetch_add(rc < 0 ? &misses : &hits, 1);
+	return rc;
+}
+
+/* Set a value that expires after ttl ms.
+ */
+int store_set(const char *key, const void *val, int len, unsigned int ttl)
+{
+	unsigned int klen = strlen(key);
+	unsigned int hash = store_hash(key, klen);
+	unsigned long long now = timer_clock();
+	_Atomic(StoreEntry *) *link;
+	StoreEntry *e, *old;
+	unsigned long need;
+
+	if(!klen || klen > STORE_KEY || len < 0 || len > STORE_VALUE
+			|| (len > 0 && val == NULL)) {
+		return -1;
+	}
+	need = sizeof(StoreEntry) + klen + len;
+
+	pthread_mutex_lock(&lock);
+	link = store_link(key, klen, hash);
+	old = atomic_load(link);
+	if(bytes + need - (old != NULL ? store_size(old) : 0) > limit) {
+		store_purge(now);
+		link = store_link(key, klen, hash);
+		old = atomic_load(link);
+		if(bytes + need - (old != NULL ? store_size(old) : 0) > limit) {
+			rejected++;
+			pthread_mutex_unlock(&lock);
+			return -1;
+		}
+	}
+
+	e = (StoreEntry *)malloc(need);
+	if(e == NULL) {
+		rejected++;
+		pthread_mutex_unlock(&lock);
+		return -1;
+	}
+	e->retired = NULL;
+	e->expires = ttl ? now + ttl : 0;
+	e->hash = hash;
+	e->klen = klen;
+	e->vlen = len;
+	memcpy(e->data, key, klen);
+	if(len > 0) {
+		memcpy(e->data + klen, val, len);
+	}
+
+	/* Entry is complete before readers can reach it. */
+	atomic_init(&e->next, old != NULL ? atomic_load(&old->next) : NULL);
+	atomic_store(link, e);
+	if(old != NULL) {
+		store_retire(old);
+	}
+	keys++;
+	bytes += need;
+	store_reclaim();
+	pthread_mutex_unlock(&lock);
+	return 0;
+}
+
+/* Delete a value.
+ */
+int store_del(const char *key)
+{
+	unsigned int klen = strlen(key);
+	unsigned int hash = store_hash(key, klen);
+	_Atomic(StoreEntry *) *link;
+	StoreEntry *e;
+	int rc = -1;
+
+	pthread_mutex_lock(&lock);
+	link = store_link(key, klen, hash);
+	if((e = atomic_load(link)) != NULL) {
+		atomic_store(link, atomic_load(&e->next));
+		store_retire(e);
+		rc = store_expired(e, timer_clock()) ? -1 : 0;
+	}
+	store_reclaim();
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+/* Set the memory limit in bytes.
+ */
+void store_limit(unsigned long n)
+{
+	pthread_mutex_lock(&lock);
+	limit = n;
+	pthread_mutex_unlock(&lock);
+}
+
+/* Drop expired values and free retired memory.
+ */
+void store_expire(void)
+{
+	pthread_mutex_lock(&lock);
+	store_purge(timer_clock());
+	store_reclaim();
+	pthread_mutex_unlock(&lock);
+}
+
+/* Free all values.
+ */
+void store_clear(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&lock);
+	for(i = 0; i < STORE_BUCKETS; i++) {
+		StoreEntry *e;
+
+		while((e = atomic_load(&buckets[i])) != NULL) {
+			atomic_store(&buckets[i], atomic_load(&e->next));
+			store_retire(e);
+		}
+	}
+	store_reclaim();
+	pthread_mutex_unlock(&lock);
+}
+
+/* Get store statistics.
+ */
+void store_stats(StoreStats *st)
+{
+	pthread_mutex_lock(&lock);
+	st->keys = keys;
+	st->bytes = bytes;
+	st->limit = limit;
+	st->expired = expired;
+	st->rejected = rejected;
+	pthread_mutex_unlock(&lock);
+	st->hits = atomic_load(&hits);
+	st->misses = atomic_load(&misses);
+}
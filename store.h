@@ -0,0 +1,55 @@
+/*
+ * store.h - Header for the key value store shared by plugins.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _STORE_H_
+#define _STORE_H_
+
+/* Number of hash buckets, a power of two. */
+#define STORE_BUCKETS 1024
+/* Longest key and largest value in bytes. */
+#define STORE_KEY 128
+#define STORE_VALUE 32768
+/* Default limit of memory used by keys and values in bytes. */
+#define STORE_LIMIT (16*1024*1024)
+
+/* Store statistics definition and typedef. */
+struct StoreStats {
+	unsigned long keys;
+	unsigned long bytes;
+	unsigned long limit;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long expired;
+	unsigned long rejected;
+};
+typedef struct StoreStats StoreStats;
+
+/* Get a value, returns its full length or -1 if there is none. */
+extern int store_get(const char *key, void *buf, int len);
+
+/* Set a value that expires after ttl ms, zero never, returns 0 on success. */
+extern int store_set(const char *key, const void *val, int len,
+	unsigned int ttl);
+
+/* Delete a value, returns 0 if it was there. */
+extern int store_del(const char *key);
+
+/* Set the memory limit in bytes. */
+extern void store_limit(unsigned long bytes);
+
+/* Drop expired values and free retired memory. */
+extern void store_expire(void);
+
+/* Free all values. */
+extern void store_clear(void);
+
+/* Get store statistics. */
+extern void store_stats(StoreStats *stats);
+
+#endif
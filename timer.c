@@ -0,0 +1,224 @@
+/*
+ * timer.c - Source for a hierarchical timer wheel.
+ *
+ * Timers sit in intrusive lists so adding and cancelling are O(1). Level
+ * zero holds timers due within TIMER_SLOTS ticks, each higher level
+ * covers TIMER_SLOTS times the range of the one below and is cascaded
+ * down whenever the level below wraps around.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer.h"
+#include "trace.h"
+
+#define TIMER_MASK (TIMER_SLOTS-1)
+
+/* Wheel slots are list heads, only next and prev are used. */
+static Timer wheel[TIMER_LEVELS][TIMER_SLOTS];
+static unsigned long long wheel_tick;
+static unsigned int wheel_count;
+static int wheel_ready;
+
+/* Set up empty slots.
+ */
+static void timer_setup(void)
+{
+	int i, j;
+
+	for(i = 0; i < TIMER_LEVELS; i++) {
+		for(j = 0; j < TIMER_SLOTS; j++) {
+			wheel[i][j].next = &wheel[i][j];
+			wheel[i][j].prev = &wheel[i][j];
+		}
+	}
+	wheel_tick = timer_clock() / TIMER_TICK;
+	wheel_ready = 1;
+}
+
+/* Put a timer into the slot matching its expiry.
+ */
+static void timer_link(Timer *t)
+{
+	unsigned long long delta;
+	Timer *head;
+	int level;
+
+	if(t->expires <= wheel_tick) {
+		t->expires = wheel_tick + 1;
+	}
+	delta = t->expires - wheel_tick;
+	for(level = 0; level < TIMER_LEVELS - 1; level++) {
+		if(delta < (1ULL << (TIMER_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	if(level == TIMER_LEVELS - 1
+			&& delta >= (1ULL << (TIMER_BITS * TIMER_LEVELS))) {
+		t->expires = wheel_tick
+			+ (1ULL << (TIMER_BITS * TIMER_LEVELS)) - 1;
+	}
+	head = &wheel[level][(t->expires >> (TIMER_BITS * level))
+		& TIMER_MASK];
+	t->prev = head->prev;
+	t->next = head;
+	head->prev->next = t;
+	head->prev = t;
+	++wheel_count;
+}
+
+/* Move timers of a higher level slot down the wheel.
+ */
+static void timer_cascade(int level)
+{
+	Timer *head = &wheel[level][(wheel_tick >> (TIMER_BITS * level))
+		& TIMER_MASK];
+	Timer *t = head->next;
+
+	head->next = head->prev = head;
+	while(t != head) {
+		Timer *next = t->next;
+		--wheel_count;
+		timer_link(t);
+		t = next;
+	}
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Get milliseconds from a monotonic clock.
+ */
+unsigned long long timer_clock(void)
+{
+	return trace_now() / 1000000ULL;
+}
+
+/* Start the wheel at the current time.
+ */
+void timer_start(void)
+{
+	if(!wheel_ready) {
+		timer_setup();
+	}
+}
+
+/* Initialize a timer with a callback.
+ */
+void timer_init(Timer *t, void (*func)(Timer *self, void *arg), void *arg)
+{
+	memset(t, 0, sizeof(Timer));
+	t->func = func;
+	t->arg = arg;
+}
+
+/* Arm a timer to fire once after given milliseconds.
+ */
+void timer_add(Timer *t, unsigned long ms)
+{
+	timer_start();
+	timer_cancel(t);
+	t->period = 0;
+	t->expires = wheel_tick + (ms + TIMER_TICK - 1) / TIMER_TICK;
+	timer_link(t);
+}
+
+/* Arm a timer to fire every given milliseconds.
+ */
+void timer_every(Timer *t, unsigned long ms)
+{
+	timer_add(t, ms);
+	t->period = ms;
+}
+
+/* Disarm a timer.
+ */
+void timer_cancel(Timer *t)
+{
+	if(t->next != NULL) {
+		t->prev->next = t->next;
+		t->next->prev = t->prev;
+		t->next = t->prev = NULL;
+		--wheel_count;
+	}
+}
+
+/* Check if a timer is armed.
+ */
+int timer_pending(const Timer *t)
+{
+	return t->next != NULL;
+}
+
+/* Run every timer that expired up to now.
+ */
+void timer_advance(void)
+{
+	unsigned long long now;
+
+	timer_start();
+	now = timer_clock() / TIMER_TICK;
+	while(wheel_tick < now) {
+		Timer *head;
+		int level;
+
+		++wheel_tick;
+		for(level = 1; level < TIMER_LEVELS; level++) {
+			if((wheel_tick >> (TIMER_BITS * (level - 1)))
+					& TIMER_MASK) {
+				break;
+			}
+			timer_cascade(level);
+		}
+
+		head = &wheel[0][wheel_tick & TIMER_MASK];
+		while(head->next != head) {
+			Timer *t = head->next;
+
+			timer_cancel(t);
+			if(t->period) {
+				t->expires = wheel_tick
+					+ (t->period + TIMER_TICK - 1) / TIMER_TICK;
+				timer_link(t);
+			}
+			t->func(t, t->arg);
+		}
+		if(!wheel_count) {
+			wheel_tick = now;
+		}
+	}
+}
+
+/* Milliseconds until the wheel needs to run again.
+ */
+int timer_next(void)
+{
+	unsigned long long now;
+	long wait;
+	int i;
+
+	if(!wheel_ready || !wheel_count) {
+		return -1;
+	}
+
+	for(i = 1; i <= TIMER_SLOTS; i++) {
+		Timer *head = &wheel[0][(wheel_tick + i) & TIMER_MASK];
+		if(head->next != head) {
+			break;
+		}
+	}
+
+	/* Nothing on level zero, wake up for the next cascade. */
+	if(i > TIMER_SLOTS) {
+		i = TIMER_SLOTS - (wheel_tick & TIMER_MASK);
+	}
+	now = timer_clock();
+	wait = (long)((wheel_tick + i) * TIMER_TICK - now);
+	return wait < 0 ? 0 : (int)wait;
+}
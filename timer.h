@@ -0,0 +1,60 @@
+/*
+ * timer.h - Header for a hierarchical timer wheel.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/* Length of a tick in milliseconds. */
+#define TIMER_TICK 10
+/* Wheel levels and slots per level, covers about 46 hours. */
+#define TIMER_LEVELS 4
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+
+/* Timer definition and typedef. */
+struct Timer;
+typedef struct Timer Timer;
+struct Timer {
+	Timer *next;
+	Timer *prev;
+	unsigned long long expires;
+	unsigned long period;
+	void (*func)(Timer *self, void *arg);
+	void *arg;
+};
+
+/* Get milliseconds from a monotonic clock. */
+extern unsigned long long timer_clock(void);
+
+/* Start the wheel at the current time. */
+extern void timer_start(void);
+
+/* Initialize a timer with a callback. */
+extern void timer_init(Timer *t, void (*func)(Timer *self, void *arg),
+	void *arg);
+
+/* Arm a timer to fire once after given milliseconds. */
+extern void timer_add(Timer *t, unsigned long ms);
+
+/* Arm a timer to fire every given milliseconds. */
+extern void timer_every(Timer *t, unsigned long ms);
+
+/* Disarm a timer, safe to call on a timer that is not armed. */
+extern void timer_cancel(Timer *t);
+
+/* Check if a timer is armed. */
+extern int timer_pending(const Timer *t);
+
+/* Run every timer that expired up to now. */
+extern void timer_advance(void);
+
+/* Milliseconds until the wheel needs to run again, -1 if idle. */
+extern int timer_next(void);
+
+#endif
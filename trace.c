@@ -0,0 +1,292 @@
+/*
+ * trace.c - Source for request tracing in Chrome trace format.
+ *
+ * Every thread records spans into its own ring, the writer only ever
+ * publishes its head index so recording never takes a lock. When a ring
+ * is full the oldest events are overwritten; trace_dump() re-checks the
+ * head after copying and drops anything that was overwritten meanwhile.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "trace.h"
+#include "session.h"
+
+#define TRACE_MASK (TRACE_RING-1)
+
+/* Trace event definition and typedef. */
+struct TraceEvent {
+	char name[TRACE_NAME];
+	unsigned long long ts;
+	unsigned long long dur;
+	long fd;
+};
+typedef struct TraceEvent TraceEvent;
+
+/* Trace ring definition and typedef. */
+struct TraceRing {
+	atomic_ullong head;
+	unsigned long long tail;
+	unsigned int tid;
+	TraceEvent ev[TRACE_RING];
+};
+typedef struct TraceRing TraceRing;
+
+static TraceRing *rings[TRACE_THREADS];
+static atomic_uint ring_count;
+static _Thread_local TraceRing *ring;
+
+static atomic_uint sessions_on;
+static atomic_uint sample_every;
+static atomic_uint sample_count;
+static unsigned long long epoch;
+
+/* Get ring of calling thread, registering it on first use.
+ */
+static TraceRing *trace_ring(void)
+{
+	unsigned int i;
+
+	if(ring != NULL) {
+		return ring;
+	}
+	i = atomic_fetch_add(&ring_count, 1);
+	if(i >= TRACE_THREADS) {
+		atomic_fetch_sub(&ring_count, 1);
+		return NULL;
+	}
+	ring = (TraceRing *)calloc(1, sizeof(TraceRing));
+	if(ring != NULL) {
+		ring->tid = i + 1;
+	}
+	rings[i] = ring;
+	return ring;
+}
+
+/* Copy a span name escaped for a JSON string.
+ */
+static void trace_escape(char *out, const char *name)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	for(; *name; name++) {
+		unsigned char ch = (unsigned char)*name;
+
+		if(ch == '"' || ch == '\\') {
+			*out++ = '\\';
+			*out++ = ch;
+		}
+		else if(ch < 0x20) {
+			*out++ = '\\';
+			*out++ = 'u';
+			*out++ = '0';
+			*out++ = '0';
+			*out++ = hex[ch >> 4];
+			*out++ = hex[ch & 0xf];
+		}
+		else {
+			*out++ = ch;
+		}
+	}
+	*out = 0;
+}
+
+/* Write a single event as JSON.
+ */
+static void trace_write(FILE *fp, const TraceEvent *ev, unsigned int tid,
+	int first)
+{
+	char name[TRACE_NAME*6];
+
+	trace_escape(name, ev->name);
+	fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+		"\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"fd\":%ld}}",
+		first ? "" : ",", name,
+		(ev->ts - epoch) / 1000.0, ev->dur / 1000.0, tid, ev->fd);
+}
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Get a monotonic timestamp in nanoseconds.
+ */
+unsigned long long trace_now(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if(!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return (unsigned long long)(now.QuadPart * 1000000000.0
+		/ freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Switch tracing on or off for a session.
+ */
+void trace_enable(const SOCKET fd, int on)
+{
+	Session *s = session_get(fd);
+
+	if(s == NULL || !(s->trace & TRACE_SESSION) == !on) {
+		return;
+	}
+	if(on) {
+		s->trace |= TRACE_SESSION;
+		atomic_fetch_add(&sessions_on, 1);
+	}
+	else {
+		s->trace &= ~TRACE_SESSION;
+		atomic_fetch_sub(&sessions_on, 1);
+	}
+	if(!epoch) {
+		epoch = trace_now();
+	}
+}
+
+/* Trace one in every N requests of all sessions.
+ */
+void trace_sample(unsigned int every)
+{
+	atomic_store(&sample_every, every);
+	if(!epoch) {
+		epoch = trace_now();
+	}
+}
+
+/* Start a request, decides if it is traced.
+ */
+void trace_request(const SOCKET fd)
+{
+	unsigned int every = atomic_load_explicit(&sample_every,
+		memory_order_relaxed);
+	Session *s;
+
+	if(!every && !atomic_load_explicit(&sessions_on,
+			memory_order_relaxed)) {
+		return;
+	}
+	s = session_get(fd);
+	if(s == NULL) {
+		return;
+	}
+	s->trace &= ~TRACE_ACTIVE;
+	if((s->trace & TRACE_SESSION) || (every
+			&& atomic_fetch_add(&sample_count, 1) % every == 0)) {
+		s->trace |= TRACE_ACTIVE;
+	}
+}
+
+/* Begin a span, returns zero if the request is not traced.
+ */
+unsigned long long trace_begin(const SOCKET fd)
+{
+	Session *s;
+
+	if(!atomic_load_explicit(&sample_every, memory_order_relaxed)
+			&& !atomic_load_explicit(&sessions_on,
+				memory_order_relaxed)) {
+		return 0;
+	}
+	s = session_get(fd);
+	if(s == NULL || !(s->trace & TRACE_ACTIVE)) {
+		return 0;
+	}
+	return trace_now();
+}
+
+/* End a span started by trace_begin().
+ */
+void trace_end(const SOCKET fd, const char *name, unsigned long long start)
+{
+	unsigned long long head;
+	TraceRing *r;
+	TraceEvent *ev;
+
+	if(!start || (r = trace_ring()) == NULL) {
+		return;
+	}
+	head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	ev = &r->ev[head & TRACE_MASK];
+	/* Names may live in a plugin that is unloaded before the dump. */
+	snprintf(ev->name, sizeof(ev->name), "%s", name);
+	ev->ts = start;
+	ev->dur = trace_now() - start;
+	ev->fd = (long)fd;
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+/* Write all recorded events to a file.
+ */
+int trace_dump(const char *path)
+{
+	unsigned int count = atomic_load(&ring_count);
+	TraceEvent *copy;
+	unsigned int i;
+	int total = 0;
+	FILE *fp;
+
+	if((fp = fopen(path, "w")) == NULL) {
+		return -1;
+	}
+	copy = (TraceEvent *)malloc(sizeof(TraceEvent) * TRACE_RING);
+	if(copy == NULL) {
+		fclose(fp);
+		return -1;
+	}
+
+	fprintf(fp, "{\"traceEvents\":[");
+	for(i = 0; i < count && i < TRACE_THREADS; i++) {
+		TraceRing *r = rings[i];
+		unsigned long long head, start, j;
+
+		if(r == NULL) {
+			continue;
+		}
+		head = atomic_load_explicit(&r->head, memory_order_acquire);
+		start = head - r->tail > TRACE_RING ? head - TRACE_RING : r->tail;
+		for(j = start; j < head; j++) {
+			copy[j & TRACE_MASK] = r->ev[j & TRACE_MASK];
+		}
+
+		/* Anything the writer lapped while copying is garbage. */
+		j = atomic_load_explicit(&r->head, memory_order_acquire);
+		if(j + 1 - start > TRACE_RING) {
+			start = j + 1 - TRACE_RING;
+		}
+		for(j = start; j < head; j++) {
+			trace_write(fp, &copy[j & TRACE_MASK], r->tid, !total);
+			++total;
+		}
+		r->tail = head;
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	fclose(fp);
+	free(copy);
+	return total;
+}
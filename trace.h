@@ -0,0 +1,49 @@
+/*
+ * trace.h - Header for request tracing in Chrome trace format.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "prs/network.h"
+
+/* Events kept per thread, must be a power of two. */
+#define TRACE_RING 8192
+/* Most threads that can record events. */
+#define TRACE_THREADS 64
+/* Longest span name kept, longer names are cut. */
+#define TRACE_NAME 32
+/* File written by trace_dump(). */
+#define TRACE_FILE "netcom-trace.json"
+
+/* Session trace flags. */
+enum { TRACE_SESSION = 1, TRACE_ACTIVE = 2 };
+
+/* Get a monotonic timestamp in nanoseconds. */
+extern unsigned long long trace_now(void);
+
+/* Switch tracing on or off for a session. */
+extern void trace_enable(const SOCKET fd, int on);
+
+/* Trace one in every N requests of all sessions, zero disables. */
+extern void trace_sample(unsigned int every);
+
+/* Start a request, decides if it is traced. */
+extern void trace_request(const SOCKET fd);
+
+/* Begin a span, returns zero if the request is not traced. */
+extern unsigned long long trace_begin(const SOCKET fd);
+
+/* End a span started by trace_begin(). */
+extern void trace_end(const SOCKET fd, const char *name,
+	unsigned long long start);
+
+/* Write all recorded events to a file, returns number of events. */
+extern int trace_dump(const char *path);
+
+#endif
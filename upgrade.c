@@ -0,0 +1,407 @@
+/*
+ * upgrade.c - Source for handing the server over to a new binary.
+ *
+ * The old process starts the new binary with UPGRADE_ENV pointing at a
+ * Unix socket and passes it the listening socket with SCM_RIGHTS, plus
+ * every session and its state when asked to. The listening socket stays
+ * open the whole time so clients never see a refused connect; the old
+ * process stops accepting and exits once its own sessions are gone.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "upgrade.h"
+#include "session.h"
+#include "output.h"
+#include "trace.h"
+#include "limit.h"
+#include "log.h"
+#include "capture.h"
+
+#define UPGRADE_MAGIC "NCUP"
+#define UPGRADE_VERSION 2
+
+/* Handover greeting definition and typedef. */
+struct UpgradeHello {
+	char magic[4];
+	unsigned int version;
+	unsigned int sessions;
+	char cwd[UPGRADE_PATHLEN];
+};
+typedef struct UpgradeHello UpgradeHello;
+
+/* Handed over session definition and typedef. */
+struct UpgradeSession {
+	char addr[INET6_ADDRSTRLEN+1];
+	int mode;
+	int trace;
+	unsigned int used;
+	char line[SESSION_LINE];
+	char cwd[SESSION_PATH];
+};
+typedef struct UpgradeSession UpgradeSession;
+
+static char exe[UPGRADE_PATHLEN];
+static char start_dir[UPGRADE_PATHLEN];
+static char **start_argv;
+static int pending;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Check if a session can be handed over, channels and sessions with
+ * output waiting stay behind.
+ */
+static int upgrade_movable(const Session *s)
+{
+	return s->chan == NULL && s->mux == NULL && s->wlen == 0;
+}
+
+/* Send a message with a socket attached.
+ */
+static int upgrade_sendfd(int chan, const void *buf, size_t len, int fd)
+{
+	char ctl[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(ctl, 0, sizeof(ctl));
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl;
+	msg.msg_controllen = sizeof(ctl);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	return sendmsg(chan, &msg, 0) == (ssize_t)len ? 0 : -1;
+}
+
+/* Receive a message with a socket attached.
+ */
+static int upgrade_recvfd(int chan, void *buf, size_t len)
+{
+	char ctl[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl;
+	msg.msg_controllen = sizeof(ctl);
+
+	if(recvmsg(chan, &msg, MSG_WAITALL) != (ssize_t)len) {
+		return -1;
+	}
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+			&& cmsg->cmsg_type == SCM_RIGHTS) {
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	return fd;
+}
+
+/* Start the new binary, returns the handover socket it connected to.
+ */
+static int upgrade_spawn(SOCKET listener)
+{
+	struct sockaddr_un sun;
+	struct pollfd pfd;
+	char path[sizeof(sun.sun_path)];
+	int srv, chan = -1;
+	pid_t pid;
+
+	snprintf(path, sizeof(path), "%s-%ld.sock", UPGRADE_PATH,
+		(long)getpid());
+	unlink(path);
+
+	if((srv = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	memcpy(sun.sun_path, path, strlen(path) + 1);
+	if(bind(srv, (struct sockaddr *)&sun, sizeof(sun)) < 0
+			|| listen(srv, 1) < 0) {
+		close(srv);
+		return -1;
+	}
+
+	signal(SIGCHLD, SIG_IGN);
+	if((pid = fork()) < 0) {
+		close(srv);
+		unlink(path);
+		return -1;
+	}
+	if(pid == 0) {
+		unsigned int pos = 0;
+		Session *s;
+
+		/* Only what is handed over may stay open in the new binary. */
+		while((s = session_next(&pos)) != NULL) {
+			if(s->chan == NULL) {
+				close(s->fd);
+			}
+		}
+		close(listener);
+		close(srv);
+
+		/* An ignored SIGCHLD would be kept across execv(). */
+		signal(SIGCHLD, SIG_DFL);
+		if(chdir(start_dir) == 0 && setenv(UPGRADE_ENV, path, 1) == 0) {
+			execv(exe, start_argv);
+		}
+		_exit(127);
+	}
+
+	pfd.fd = srv;
+	pfd.events = POLLIN;
+	if(poll(&pfd, 1, UPGRADE_TIMEOUT) == 1) {
+		chan = accept(srv, NULL, NULL);
+	}
+	else {
+		kill(pid, SIGTERM);
+	}
+	close(srv);
+	unlink(path);
+	return chan;
+}
+#endif
+
+/* -------------------------- Public Functions --------------------------- */
+
+/* Remember how this binary was started.
+ */
+void upgrade_init(char *argv[])
+{
+	start_argv = argv;
+#if !defined(_WIN32) && !defined(_WIN64)
+	{
+		ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+		if(len > 0) {
+			exe[len] = 0;
+		}
+		else if(realpath(argv[0], exe) == NULL) {
+			snprintf(exe, sizeof(exe), "%s", argv[0]);
+		}
+		if(getcwd(start_dir, sizeof(start_dir)) == NULL) {
+			snprintf(start_dir, sizeof(start_dir), ".");
+		}
+	}
+#endif
+}
+
+/* Schedule an upgrade.
+ */
+int upgrade_request(int mode)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return -1;
+#else
+	if(mode != UPGRADE_LISTENER && mode != UPGRADE_SESSIONS) {
+		return -1;
+	}
+	pending = mode;
+	return 0;
+#endif
+}
+
+/* Get the scheduled upgrade mode.
+ */
+int upgrade_pending(void)
+{
+	return pending;
+}
+
+/* Start the new binary and hand the listener over.
+ */
+int upgrade_run(SOCKET listener)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	pending = UPGRADE_NONE;
+	return -1;
+#else
+	UpgradeHello hello;
+	unsigned int pos = 0;
+	unsigned int sent = 0, i;
+	SOCKET *moved = NULL;
+	Session *s;
+	int mode = pending;
+	int chan;
+
+	pending = UPGRADE_NONE;
+	log_write(PMLOG_INFO, "Upgrading to %s.", exe);
+	if((chan = upgrade_spawn(listener)) < 0) {
+		log_write(PMLOG_ERROR, "Upgrade failed, new binary did not start.");
+		return -1;
+	}
+
+	memset(&hello, 0, sizeof(hello));
+	memcpy(hello.magic, UPGRADE_MAGIC, 4);
+	hello.version = UPGRADE_VERSION;
+	hello.sessions = 0;
+	while(mode == UPGRADE_SESSIONS && (s = session_next(&pos)) != NULL) {
+		hello.sessions += upgrade_movable(s);
+	}
+	pos = 0;
+	if(hello.sessions > 0 && (moved = (SOCKET *)malloc(hello.sessions
+			* sizeof(SOCKET))) == NULL) {
+		log_write(PMLOG_ERROR, "Upgrade failed, out of memory.");
+		close(chan);
+		return -1;
+	}
+	if(getcwd(hello.cwd, sizeof(hello.cwd)) == NULL) {
+		snprintf(hello.cwd, sizeof(hello.cwd), "%s", start_dir);
+	}
+	if(upgrade_sendfd(chan, &hello, sizeof(hello), listener) < 0) {
+		log_write(PMLOG_ERROR, "Upgrade failed, cannot pass listener.");
+		free(moved);
+		close(chan);
+		return -1;
+	}
+
+	while(sent < hello.sessions && (s = session_next(&pos)) != NULL) {
+		UpgradeSession us;
+
+		if(!upgrade_movable(s)) {
+			continue;
+		}
+		memset(&us, 0, sizeof(us));
+		memcpy(us.addr, s->addr, sizeof(us.addr));
+		us.mode = out_getmode(s->fd);
+		us.trace = s->trace & TRACE_SESSION;
+		us.used = s->used;
+		memcpy(us.line, s->line, s->used);
+		memcpy(us.cwd, s->cwd, sizeof(us.cwd));
+		if(upgrade_sendfd(chan, &us, sizeof(us), s->fd) < 0) {
+			log_write(PMLOG_WARN, "Upgrade passed %u of %u sessions.",
+				sent, hello.sessions);
+			break;
+		}
+		moved[sent++] = s->fd;
+	}
+	close(chan);
+
+	/* Sessions sent now belong to the new binary, the rest stay here. */
+	for(i = 0; i < sent; i++) {
+		if((s = session_get(moved[i])) == NULL) {
+			continue;
+		}
+		trace_enable(moved[i], 0);
+		capture_close(s);
+		limit_disconnect(s->limit);
+		session_close(moved[i]);
+		socket_close(moved[i]);
+	}
+	free(moved);
+	log_write(PMLOG_INFO, "Upgrade handed over, draining.");
+	return 0;
+#endif
+}
+
+/* Take over listener and sessions from an old binary.
+ */
+SOCKET upgrade_receive(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return INVALID_SOCKET;
+#else
+	const char *path = getenv(UPGRADE_ENV);
+	struct sockaddr_un sun;
+	UpgradeHello hello;
+	unsigned int i;
+	int chan, listener;
+
+	if(path == NULL) {
+		return INVALID_SOCKET;
+	}
+	if((chan = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return INVALID_SOCKET;
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", path);
+	unsetenv(UPGRADE_ENV);
+	if(connect(chan, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+		close(chan);
+		return INVALID_SOCKET;
+	}
+
+	listener = upgrade_recvfd(chan, &hello, sizeof(hello));
+	if(listener < 0 || memcmp(hello.magic, UPGRADE_MAGIC, 4)
+			|| hello.version != UPGRADE_VERSION) {
+		if(listener >= 0) {
+			close(listener);
+		}
+		close(chan);
+		return INVALID_SOCKET;
+	}
+	hello.cwd[sizeof(hello.cwd)-1] = 0;
+	if(chdir(hello.cwd) != 0) {
+		log_write(PMLOG_WARN, "Cannot change to %s.", hello.cwd);
+	}
+
+	for(i = 0; i < hello.sessions; i++) {
+		UpgradeSession us;
+		Session *s;
+		int fd;
+
+		if((fd = upgrade_recvfd(chan, &us, sizeof(us))) < 0) {
+			break;
+		}
+		us.addr[sizeof(us.addr)-1] = 0;
+		if((s = session_open(fd, us.addr)) == NULL) {
+			close(fd);
+			continue;
+		}
+		s->limit = limit_attach(us.addr);
+		s->used = us.used < SESSION_LINE ? us.used : 0;
+		memcpy(s->line, us.line, s->used);
+		us.cwd[sizeof(us.cwd)-1] = 0;
+		if(us.cwd[0] != '\0') {
+			memcpy(s->cwd, us.cwd, sizeof(s->cwd));
+		}
+		if(us.mode != OUT_RAW) {
+			out_setmode(fd, us.mode);
+			out_end(fd);
+		}
+		if(us.trace) {
+			trace_enable(fd, 1);
+		}
+	}
+	close(chan);
+	log_write(PMLOG_INFO, "Took over listener and %d sessions.",
+		session_count());
+	return listener;
+#endif
+}
@@ -0,0 +1,41 @@
+/*
+ * upgrade.h - Header for handing the server over to a new binary.
+ *
+ * Author: Philip R. Simonson
+ * Date  : 10/19/2026
+ *
+ ****************************************************************************
+ */
+
+#ifndef _UPGRADE_H_
+#define _UPGRADE_H_
+
+#include "prs/network.h"
+
+/* Environment variable naming the handover socket of a new binary. */
+#define UPGRADE_ENV "NETCOM_UPGRADE"
+/* Handover socket, the process id is appended. */
+#define UPGRADE_PATH "/tmp/netcom-upgrade"
+/* Longest wait for the new binary to connect (ms). */
+#define UPGRADE_TIMEOUT 5000
+#define UPGRADE_PATHLEN 1024
+
+/* Upgrade modes. */
+enum { UPGRADE_NONE, UPGRADE_LISTENER, UPGRADE_SESSIONS };
+
+/* Remember how this binary was started, call first thing in main(). */
+extern void upgrade_init(char *argv[]);
+
+/* Schedule an upgrade, it runs between requests. */
+extern int upgrade_request(int mode);
+
+/* Get the scheduled upgrade mode. */
+extern int upgrade_pending(void);
+
+/* Start the new binary and hand the listener over, sessions too. */
+extern int upgrade_run(SOCKET listener);
+
+/* Take over listener and sessions from an old binary, if started so. */
+extern SOCKET upgrade_receive(void);
+
+#endif